@@ -26,3 +26,4 @@
 #define SYS_get_cfs_stats  25
 #define SYS_set_policy  26
 
+#define SYS_sbrkeager  27
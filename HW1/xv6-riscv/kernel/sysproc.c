@@ -50,19 +50,34 @@ sys_wait(void) // task 3.3
   return wait(p,addedP);
 }
 
-uint64
-sys_sbrk(void)
+// sbrk() leaves the pages it adds for the first touch to map;
+// sbrkeager() maps them at once, for callers that would rather
+// not take the faults.
+static uint64
+dosbrk(int eager)
 {
   uint64 addr;
   int n;
 
   argint(0, &n);
   addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if(growproc(n, eager) < 0)
     return -1;
   return addr;
 }
 
+uint64
+sys_sbrk(void)
+{
+  return dosbrk(0);
+}
+
+uint64
+sys_sbrkeager(void)
+{
+  return dosbrk(1);
+}
+
 uint64
 sys_sleep(void)
 {
@@ -0,0 +1,75 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+// Cost of growing the heap with sbrk(), which leaves new pages for
+// the first touch to map, against sbrkeager(), which maps them all
+// at once. A program that touches a few of the pages it asks for,
+// as malloc() does with its 64 KB chunks, should pay for those only.
+// Prints one tab-separated row per result:
+//   bench  pages  value  unit
+//   sbrkbench [maxpages]
+//
+// The same file is in every tree but HW1's, whose exit() takes its
+// extra argument. A tree that swaps (NUSERFRAME) gets a smaller
+// default heap.
+
+#define PGSIZE        4096
+#define NS_PER_CYCLE  100   // qemu virt's time CSR runs at 10MHz
+#define STRIDE        8     // touch one page in STRIDE
+
+#ifdef NUSERFRAME
+int maxpages = NUSERFRAME - 32; // nothing swaps, next to the other processes
+#else
+int maxpages = 1024;
+#endif
+
+static inline uint64
+now(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+void
+report(char *bench, int pages, uint64 value, char *unit)
+{
+  printf("%s\t%d\t%l\t%s\n", bench, pages, value, unit);
+}
+
+// us to grow the heap by n pages with grow(), store to every
+// stride'th of them, and give them back.
+uint64
+bench_sbrk(char *(*grow)(int), int n, int stride)
+{
+  uint64 t0 = now();
+  char *a;
+
+  if((a = grow(n * PGSIZE)) == (char*)-1){
+    printf("sbrkbench: sbrk failed\n");
+    exit(1, 0);
+  }
+  for(int i = 0; i < n; i += stride)
+    a[i * PGSIZE] = i;
+  sbrk(-n * PGSIZE);
+  return (now() - t0) * NS_PER_CYCLE / 1000;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1)
+    maxpages = atoi(argv[1]);
+
+  printf("# sbrkbench maxpages=%d stride=%d\n", maxpages, STRIDE);
+  printf("bench\tpages\tvalue\tunit\n");
+  for(int n = 64; n <= maxpages; n *= 2){
+    report("sbrk_sparse", n, bench_sbrk(sbrk, n, STRIDE), "us");
+    report("sbrkeager_sparse", n, bench_sbrk(sbrkeager, n, STRIDE), "us");
+    report("sbrk_dense", n, bench_sbrk(sbrk, n, 1), "us");
+    report("sbrkeager_dense", n, bench_sbrk(sbrkeager, n, 1), "us");
+  }
+  exit(0, 0);
+}
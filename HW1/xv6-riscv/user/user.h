@@ -20,6 +20,7 @@ int chdir(const char*);
 int dup(int);
 int getpid(void);
 char* sbrk(int);
+char* sbrkeager(int);
 int sleep(int);
 int uptime(void);
 int memsize(void);//task2
@@ -41,3 +41,4 @@ entry("set_ps_priority");
 entry("set_cfs_priority");
 entry("get_cfs_stats");
 entry("set_policy");
+entry("sbrkeager");
@@ -17,6 +17,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "file.h"
+#include "fcntl.h"
 #include "memlayout.h"
 #include "riscv.h"
 #include "defs.h"
@@ -170,6 +171,7 @@ consoleintr(int c)
         // has arrived.
         cons.w = cons.e;
         wakeup(&cons.r);
+        pollwakeup();
       }
     }
     break;
@@ -178,6 +180,20 @@ consoleintr(int c)
   release(&cons.lock);
 }
 
+// a whole line is ready to be read once cons.w has moved past cons.r.
+// output never waits for long, so the console is always writable.
+int
+consolepoll(void)
+{
+  int revents = POLLOUT;
+
+  acquire(&cons.lock);
+  if(cons.r != cons.w)
+    revents |= POLLIN;
+  release(&cons.lock);
+  return revents;
+}
+
 void
 consoleinit(void)
 {
@@ -189,4 +205,5 @@ consoleinit(void)
   // to consoleread and consolewrite.
   devsw[CONSOLE].read = consoleread;
   devsw[CONSOLE].write = consolewrite;
+  devsw[CONSOLE].poll = consolepoll;
 }
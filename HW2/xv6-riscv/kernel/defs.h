@@ -9,6 +9,7 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct kthread;
+struct kthread_stat;
 
 // bio.c
 void            binit(void);
@@ -34,6 +35,9 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filepoll(struct file*, int);
+int             filepollwait(uint64, int, int);
+void            pollwakeup(void);
 
 // fs.c
 void            fsinit(int);
@@ -60,10 +64,17 @@ void            ramdiskinit(void);
 void            ramdiskintr(void);
 void            ramdiskrw(struct buf*);
 
+// ipi.c
+void            ipi_send(int);
+void            ipiintr(void);
+void            tlbshootdown(pagetable_t);
+
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            krefinc(void *);
+int             krefcount(void *);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -74,8 +85,9 @@ void            end_op(void);
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, uint64, int, int);
+int             pipewrite(struct pipe*, uint64, int, int);
+int             pipepoll(struct pipe*, int);
 
 // printf.c
 void            printf(char*, ...);
@@ -86,7 +98,7 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
+int             growproc(int, int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
@@ -113,6 +125,8 @@ int             kthread_kill(int ktid);
 void            kthread_exit(int status);
 int             kthread_join(int ktid, int* status);
 int             kthread_killed(struct kthread *);
+int             kthread_sigalarm(int ticks, uint64 handler);
+uint64          kthread_sigreturn(uint64 frame);
 
 // kthread.c
 void                kthreadinit(struct proc *);
@@ -121,6 +135,10 @@ struct kthread*     mykthread();
 int                 allockid(struct proc *);
 struct kthread*     allockthread(struct proc* , uint64 );
 void                freekthread(struct kthread *);
+void                kthread_setstate(struct kthread *, int);
+void                kthread_getstat(struct kthread *, struct kthread_stat *);
+int                 kthread_stats(int, uint64);
+int                 gangsched(int);
 
 
 // swtch.S
@@ -163,6 +181,7 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            alarmtick(struct kthread *);
 
 // uart.c
 void            uartinit(void);
@@ -181,6 +200,8 @@ void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             uvmlazy(pagetable_t, uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
@@ -201,5 +222,8 @@ void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
 void            virtio_disk_intr(void);
 
+// main.c
+extern int      ncpu_online;
+
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
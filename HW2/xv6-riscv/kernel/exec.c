@@ -139,6 +139,10 @@ exec(char *path, char **argv)
   p->sz = sz;
   kt->trapframe->epc = elf.entry;  // initial program counter = main
   kt->trapframe->sp = sp; // initial stack pointer
+  kt->trapframe->tp = kt - p->kthread; // kthread slot, for per-thread data
+  kt->alarm_interval = 0; // the old handler is gone with the old image
+  kt->alarm_ticks = 0;
+  kt->alarm_handler = 0;
   proc_freepagetable(oldpagetable, oldsz);
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
@@ -3,3 +3,25 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+#define O_NONBLOCK 0x800
+
+// fcntl() commands
+#define F_GETFL   3
+#define F_SETFL   4
+
+// read() and write() on an O_NONBLOCK file return -EAGAIN
+// instead of sleeping.
+#define EAGAIN    11
+
+// poll() events
+#define POLLIN    0x001
+#define POLLOUT   0x004
+#define POLLERR   0x008
+#define POLLHUP   0x010
+#define POLLNVAL  0x020
+
+struct pollfd {
+  int fd;
+  short events;   // requested events
+  short revents;  // returned events
+};
@@ -10,6 +10,7 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
 #include "stat.h"
 #include "proc.h"
 
@@ -19,10 +20,19 @@ struct {
   struct file file[NFILE];
 } ftable;
 
+// poll() sleepers wait on poll_seq, which pollwakeup() bumps
+// whenever a pipe or device may have become ready.
+struct {
+  struct spinlock lock;
+  int seq;
+  int npollers;
+} pollwait;
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  initlock(&pollwait.lock, "pollwait");
 }
 
 // Allocate a file structure.
@@ -35,6 +45,7 @@ filealloc(void)
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
+      f->nonblock = 0;
       release(&ftable.lock);
       return f;
     }
@@ -112,10 +123,12 @@ fileread(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
+    if(f->nonblock && devsw[f->major].poll && !(devsw[f->major].poll() & POLLIN))
+      return -EAGAIN;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
     ilock(f->ip);
@@ -140,10 +153,12 @@ filewrite(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
+    if(f->nonblock && devsw[f->major].poll && !(devsw[f->major].poll() & POLLOUT))
+      return -EAGAIN;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
@@ -180,3 +195,102 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Return the subset of events that is ready on f, plus POLLHUP or
+// POLLERR if they apply. Inodes never block.
+int
+filepoll(struct file *f, int events)
+{
+  int revents;
+
+  if(f->type == FD_PIPE){
+    revents = pipepoll(f->pipe, f->writable);
+  } else if(f->type == FD_DEVICE){
+    if(f->major < 0 || f->major >= NDEV)
+      return POLLERR;
+    revents = devsw[f->major].poll ? devsw[f->major].poll() : POLLIN | POLLOUT;
+  } else {
+    revents = POLLIN | POLLOUT;
+  }
+  if(!f->readable)
+    revents &= ~POLLIN;
+  if(!f->writable)
+    revents &= ~POLLOUT;
+  return revents & (events | POLLHUP | POLLERR);
+}
+
+// Wake up poll() sleepers. Called after a pipe or device state
+// change that might make a file ready.
+void
+pollwakeup(void)
+{
+  if(pollwait.npollers == 0)
+    return;
+  acquire(&pollwait.lock);
+  pollwait.seq++;
+  wakeup(&pollwait.seq);
+  release(&pollwait.lock);
+}
+
+// Wait until one of the nfds struct pollfd at user address fds is
+// ready, or timeout ticks have passed (timeout < 0 waits forever).
+// Returns the number of ready entries, 0 on timeout, -1 on error.
+int
+filepollwait(uint64 fds, int nfds, int timeout)
+{
+  struct proc *p = myproc();
+  struct pollfd pfd;
+  struct file *f;
+  uint ticks0;
+  int i, n, seq;
+
+  if(nfds < 0)
+    return -1;
+
+  acquire(&tickslock);
+  ticks0 = ticks;
+  release(&tickslock);
+
+  acquire(&pollwait.lock);
+  pollwait.npollers++;
+  for(;;){
+    seq = pollwait.seq;
+    release(&pollwait.lock);
+
+    n = 0;
+    for(i = 0; i < nfds; i++){
+      if(copyin(p->pagetable, (char *)&pfd, fds + i*sizeof(pfd), sizeof(pfd)) < 0){
+        n = -1;
+        break;
+      }
+      if(pfd.fd < 0){
+        pfd.revents = 0;
+      } else if(pfd.fd >= NOFILE || (f = p->ofile[pfd.fd]) == 0){
+        pfd.revents = POLLNVAL;
+      } else {
+        pfd.revents = filepoll(f, pfd.events);
+      }
+      if(pfd.revents)
+        n++;
+      if(copyout(p->pagetable, fds + i*sizeof(pfd), (char *)&pfd, sizeof(pfd)) < 0){
+        n = -1;
+        break;
+      }
+    }
+
+    acquire(&pollwait.lock);
+    if(n != 0 || killed(p) || kthread_killed(mykthread()))
+      break;
+    if(timeout >= 0 && ticks - ticks0 >= timeout)
+      break;
+    // a state change since seq was read may already have made a
+    // file ready; only sleep if there has been none.
+    if(pollwait.seq == seq)
+      sleep(&pollwait.seq, &pollwait.lock);
+  }
+  pollwait.npollers--;
+  release(&pollwait.lock);
+
+  if(n == 0 && (killed(p) || kthread_killed(mykthread())))
+    return -1;
+  return n;
+}
@@ -0,0 +1,75 @@
+//
+// Inter-processor interrupts, used for TLB shootdown.
+//
+// A hart interrupts another by writing 1 to that hart's CLINT msip
+// register. The machine-mode software interrupt lands in timervec
+// (kernelvec.S), which clears msip and raises a supervisor software
+// interrupt, and devintr() then calls ipiintr().
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+void
+ipi_send(int hart)
+{
+  *(volatile uint32*)CLINT_MSIP(hart) = 1;
+}
+
+// Carry out the TLB flushes other harts have requested from this one.
+// Every request counted in tlb_req before it is read here is covered
+// by the flush. Interrupts must be disabled.
+void
+ipiintr(void)
+{
+  struct cpu *c = mycpu();
+  uint req = c->tlb_req;
+
+  if(req == c->tlb_done)
+    return;
+  __sync_synchronize();
+  sfence_vma();
+  c->tlb_done = req;
+}
+
+// Make every other hart that may be running pagetable in user space
+// drop its stale translations, and wait until it has. Call after the
+// PTEs have been changed and before the unmapped pages are freed.
+// A hart that switches to pagetable later flushes its TLB on the way
+// to user space (trampoline.S), so only the harts running one of the
+// process's kthreads right now are interrupted.
+void
+tlbshootdown(pagetable_t pagetable)
+{
+  uint gen[NCPU];
+  struct kthread *kt;
+  int i, me;
+
+  // the PTE stores must be visible before any request is.
+  __sync_synchronize();
+
+  push_off();
+  me = cpuid();
+  sfence_vma();
+  for(i = 0; i < NCPU; i++){
+    gen[i] = 0;
+    kt = cpus[i].kthread;
+    if(i == me || kt == 0 || kt->kproc->pagetable != pagetable)
+      continue;
+    gen[i] = __sync_add_and_fetch(&cpus[i].tlb_req, 1);
+    ipi_send(i);
+  }
+
+  // interrupts are off here, so serve requests aimed at this hart
+  // while waiting, or two harts shooting at each other would deadlock.
+  for(i = 0; i < NCPU; i++){
+    while(gen[i] != 0 && (int)(cpus[i].tlb_done - gen[i]) < 0)
+      ipiintr();
+  }
+  pop_off();
+}
@@ -69,6 +69,9 @@ allockthread(struct proc* p, uint64 kforkret)
 found:
   kt->kid = allockid(p);
   kt->kstate = KUSED;
+  memset(&kt->stat, 0, sizeof(kt->stat));
+  kt->stat.last_cpu = -1;
+  kt->state_since = r_time();
   
   if ( (kt->trapframe = get_kthread_trapframe(p, kt)) == 0)
   {
@@ -103,9 +106,65 @@ freekthread(struct kthread *kt)
   kt->kchan = 0;
   kt->kkilled = 0;
   kt->kxstate = 0;
+  kt->alarm_interval = 0;
+  kt->alarm_ticks = 0;
+  kt->alarm_handler = 0;
   kt->kstate = KUNUSED;
 }
 
+// Move kt to state s, charging the time since its last change
+// to the state it leaves, both to kt and to its process total.
+// kt->klock must be held.
+void
+kthread_setstate(struct kthread *kt, int s)
+{
+  struct kthread_stat *total = &kt->kproc->total;
+  uint64 now = r_time();
+  uint64 d = now - kt->state_since;
 
+  switch(kt->kstate){
+  case KRUNNING:
+    kt->stat.run_time += d;
+    __sync_fetch_and_add(&total->run_time, d);
+    if(s == KRUNNABLE){
+      kt->stat.nivcsw++;
+      __sync_fetch_and_add(&total->nivcsw, 1);
+    } else {
+      kt->stat.nvcsw++;
+      __sync_fetch_and_add(&total->nvcsw, 1);
+    }
+    break;
+  case KRUNNABLE:
+    kt->stat.wait_time += d;
+    __sync_fetch_and_add(&total->wait_time, d);
+    break;
+  case KSLEEPING:
+    kt->stat.sleep_time += d;
+    __sync_fetch_and_add(&total->sleep_time, d);
+    break;
+  default:
+    break;
+  }
+  if(s == KRUNNING)
+    kt->stat.last_cpu = cpuid();
+  kt->kstate = s;
+  kt->state_since = now;
+}
 
+// kt's accounting as of now, including the time in its current state.
+// kt->klock must be held.
+void
+kthread_getstat(struct kthread *kt, struct kthread_stat *st)
+{
+  uint64 d = r_time() - kt->state_since;
 
+  *st = kt->stat;
+  st->kid = kt->kid;
+  st->state = kt->kstate;
+  if(kt->kstate == KRUNNING)
+    st->run_time += d;
+  else if(kt->kstate == KRUNNABLE)
+    st->wait_time += d;
+  else if(kt->kstate == KSLEEPING)
+    st->sleep_time += d;
+}
@@ -79,6 +79,8 @@ struct cpu {
   struct context kcontext;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  volatile uint tlb_req;      // TLB flushes requested by other harts (see ipi.c)
+  volatile uint tlb_done;     // value of tlb_req at this hart's last flush
 };
 
 extern struct cpu cpus[NCPU];
@@ -110,6 +112,15 @@ struct kthread
   // these are private to the process, so p->lock need not be held.
   //uint64 kkstack;               // Virtual address of kernel stack
   struct context kcontext;      // swtch() here to run process
+
+  // private to the kthread, set by sigalarm():
+  int alarm_interval;           // ticks between timer upcalls, 0 if disabled
+  int alarm_ticks;              // ticks run in user space since the last upcall
+  uint64 alarm_handler;         // user address of the upcall handler
+
+  // t->klock must be held when using these:
+  uint64 state_since;           // r_time() of the last kstate change
+  struct kthread_stat stat;     // CPU accounting, see kthread_setstate()
   
   
 };
@@ -5,11 +5,13 @@
 #include "defs.h"
 
 volatile static int started = 0;
+int ncpu_online = 0;  // harts that have reached main()
 
 // start() jumps here in supervisor mode on all CPUs.
 void
 main()
 {
+  __sync_fetch_and_add(&ncpu_online, 1);
   if(cpuid() == 0){
     consoleinit();
     printfinit();
@@ -7,6 +7,7 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
 
 #define PIPESIZE 512
 
@@ -66,6 +67,7 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pollwakeup();
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
     kfree((char*)pi);
@@ -74,7 +76,7 @@ pipeclose(struct pipe *pi, int writable)
 }
 
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, uint64 addr, int n, int nonblock)
 {
   int i = 0;
   struct proc *pr = myproc();
@@ -86,6 +88,8 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       return -1;
     }
     if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+      if(nonblock)
+        break;
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
     } else {
@@ -98,12 +102,15 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
   }
   wakeup(&pi->nread);
   release(&pi->lock);
+  pollwakeup();
 
+  if(i == 0 && n > 0 && nonblock)
+    return -EAGAIN;
   return i;
 }
 
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, uint64 addr, int n, int nonblock)
 {
   int i;
   struct proc *pr = myproc();
@@ -115,6 +122,10 @@ piperead(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
+    if(nonblock){
+      release(&pi->lock);
+      return -EAGAIN;
+    }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
   for(i = 0; i < n; i++){  //DOC: piperead-copy
@@ -126,5 +137,28 @@ piperead(struct pipe *pi, uint64 addr, int n)
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
+  pollwakeup();
   return i;
 }
+
+// readiness of the read (writable == 0) or write end of pi.
+int
+pipepoll(struct pipe *pi, int writable)
+{
+  int revents = 0;
+
+  acquire(&pi->lock);
+  if(writable){
+    if(pi->readopen == 0)
+      revents |= POLLERR;
+    else if(pi->nwrite != pi->nread + PIPESIZE)
+      revents |= POLLOUT;
+  } else {
+    if(pi->nread != pi->nwrite)
+      revents |= POLLIN;
+    if(pi->writeopen == 0)
+      revents |= POLLHUP;
+  }
+  release(&pi->lock);
+  return revents;
+}
@@ -21,6 +21,23 @@ static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
+// Gang scheduling. A process in gang mode owns the harts for slices
+// of GANG_SLICE ticks, taking turns with the other gangs: during its
+// slice every scheduler runs its runnable kthreads before anything
+// else, and outside it none of them run. When the slice ends each of
+// its kthreads is preempted by its hart's next timer tick, so the
+// gang is descheduled together. Processes not in gang mode fill the
+// harts the current gang leaves idle.
+#define GANG_SLICE 5
+
+struct {
+  struct spinlock lock;
+  struct proc *cur;            // gang owning this slice, or 0
+  uint start;                  // ticks when the slice began
+  int n;                       // processes in gang mode
+  uint rr;                     // rotates which kthread of cur is tried first
+} gang;
+
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
 // memory model when using p->parent.
@@ -54,6 +71,7 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  initlock(&gang.lock, "gang");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
@@ -132,6 +150,8 @@ found:
   
   p->pid = allocpid();
   p->state = USED;
+  memset(&p->total, 0, sizeof(p->total));
+  p->total.last_cpu = -1;
   
   // Allocate a trapframe page.
   if((p->base_trapframes = (struct trapframe *)kalloc()) == 0){
@@ -190,6 +210,12 @@ freeproc(struct proc *p)
   p->name[0] = 0;
   p->killed = 0;
   p->xstate = 0;
+  if(p->gang){
+    acquire(&gang.lock);
+    p->gang = 0;
+    gang.n--;
+    release(&gang.lock);
+  }
   
   
   p->state = UNUSED;
@@ -279,23 +305,28 @@ userinit(void)
   p->cwd = namei("/");
 
   p->state = USED;
-  p->kthread[0].kstate = KRUNNABLE;
+  kthread_setstate(&p->kthread[0], KRUNNABLE);
   release(&p->kthread[0].klock);
 
   release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
+// Grow or shrink user memory by n bytes. New pages are
+// mapped by their first touch (uvmlazy()), unless eager.
 // Return 0 on success, -1 on failure.
 int
-growproc(int n)
+growproc(int n, int eager)
 {
   uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    if(sz + n > TRAPFRAME(0))
+      return -1;
+    if(!eager)
+      sz += n;
+    else if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
       return -1;
     }
   } else if(n < 0){
@@ -334,6 +365,7 @@ fork(void)
 
   // Cause fork to return 0 in the child.
   np->kthread[0].trapframe->a0 = 0;
+  np->kthread[0].trapframe->tp = 0;
   
   release(&(np->kthread[0]).klock);
   
@@ -360,7 +392,7 @@ fork(void)
   
   np->state = USED;
   
-  np->kthread[0].kstate = KRUNNABLE;
+  kthread_setstate(&np->kthread[0], KRUNNABLE);
   
   release(&np->kthread[0].klock);
   release(&np->lock);
@@ -431,7 +463,7 @@ exit(int status)
   
   acquire(&mykthread()->klock);
   
-  mykthread()->kstate = KZOMBIE;
+  kthread_setstate(mykthread(), KZOMBIE);
   mykthread()->kxstate = status;
   
   
@@ -514,6 +546,113 @@ wait(uint64 addr)
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
+// Does p have a kthread that is running or could run? Read without
+// locks, it is only a hint.
+static int
+gang_ready(struct proc *p)
+{
+  for(struct kthread *kt = p->kthread; kt < &p->kthread[NKT]; kt++)
+    if(kt->kstate == KRUNNABLE || kt->kstate == KRUNNING)
+      return 1;
+  return 0;
+}
+
+// The gang owning the harts now, handing the slice on to the next
+// ready gang in the process table when it has run out or the current
+// gang has nothing left to run.
+static struct proc*
+gang_current(void)
+{
+  struct proc *p, *cur;
+  int i, base;
+
+  if(gang.n == 0)
+    return 0;
+  acquire(&gang.lock);
+  cur = gang.cur;
+  if(cur == 0 || !cur->gang || ticks - gang.start >= GANG_SLICE || !gang_ready(cur)){
+    base = cur ? cur - proc + 1 : 0;
+    cur = 0;
+    for(i = 0; i < NPROC; i++){
+      p = &proc[(base + i) % NPROC];
+      if(p->gang && gang_ready(p)){
+        cur = p;
+        break;
+      }
+    }
+    gang.cur = cur;
+    gang.start = ticks;
+  }
+  release(&gang.lock);
+  return cur;
+}
+
+// Run kt on this cpu. kt->klock must be held and kt RUNNABLE.
+static void
+runkthread(struct cpu *c, struct kthread *kt)
+{
+  // Switch to chosen process.  It is the process's job
+  // to release its lock and then reacquire it
+  // before jumping back to us.
+  kthread_setstate(kt, KRUNNING);
+  c->kthread = kt;
+  swtch(&c->kcontext, &kt->kcontext);
+  // Process is done running for now.
+  // It should have changed its p->state before coming back.
+  c->kthread = 0;
+}
+
+// Run one runnable kthread of the current gang, if there is one.
+static void
+gang_run(struct cpu *c)
+{
+  struct proc *p;
+  struct kthread *kt;
+  uint first;
+
+  if((p = gang_current()) == 0)
+    return;
+  acquire(&p->lock);
+  if(p->state != USED){
+    release(&p->lock);
+    return;
+  }
+  release(&p->lock);
+
+  first = __sync_fetch_and_add(&gang.rr, 1);
+  for(int i = 0; i < NKT; i++){
+    kt = &p->kthread[(first + i) % NKT];
+    acquire(&kt->klock);
+    if(kt->kstate == KRUNNABLE){
+      runkthread(c, kt);
+      release(&kt->klock);
+      return;
+    }
+    release(&kt->klock);
+  }
+}
+
+// Put the calling process in or out of gang mode.
+// Returns the previous mode.
+int
+gangsched(int on)
+{
+  struct proc *p = myproc();
+  int old;
+
+  acquire(&p->lock);
+  acquire(&gang.lock);
+  old = p->gang;
+  if(on && !old)
+    gang.n++;
+  else if(!on && old)
+    gang.n--;
+  p->gang = on != 0;
+  release(&gang.lock);
+  release(&p->lock);
+  return old;
+}
+
 void
 scheduler(void)
 {
@@ -526,24 +665,17 @@ scheduler(void)
     intr_on();
 
     for(p = proc; p < &proc[NPROC]; p++) {
+      // the current gang's kthreads go first.
+      gang_run(c);
+
       acquire(&p->lock);
-      if(p->state == USED) {
+      if(p->state == USED && !p->gang) {
           release(&p->lock);
       for(struct kthread *kt = p->kthread; kt < &p->kthread[NKT]; kt++) {
       if(!holding(&kt->klock)){
       acquire(&kt->klock);
-       if(kt->kstate == KRUNNABLE) {
-         // Switch to chosen process.  It is the process's job
-         // to release its lock and then reacquire it
-         // before jumping back to us.
-         
-         kt->kstate = KRUNNING;
-         c->kthread = kt;
-         swtch(&c->kcontext, &kt->kcontext);
-         // Process is done running for now.
-         // It should have changed its p->state before coming back.
-         c->kthread = 0;
-       }
+       if(kt->kstate == KRUNNABLE)
+         runkthread(c, kt);
       release(&kt->klock);
       }
       
@@ -594,7 +726,7 @@ yield(void)
 {
   acquire(&mykthread()->klock);
   
-  mykthread()->kstate = KRUNNABLE;
+  kthread_setstate(mykthread(), KRUNNABLE);
   
   
   sched();
@@ -648,7 +780,7 @@ sleep(void *chan, struct spinlock *lk)
   mykthread()->kproc->state = USED;
   
   mykthread()->kchan = chan;
-  mykthread()->kstate = KSLEEPING;
+  kthread_setstate(mykthread(), KSLEEPING);
   
   sched();
 
@@ -676,7 +808,7 @@ wakeup(void *chan)
         if(kt != mykthread()){
         
           if(kt->kstate == KSLEEPING && kt->kchan == chan) {
-            kt->kstate = KRUNNABLE;
+            kthread_setstate(kt, KRUNNABLE);
           }
         }
         release(&kt->klock);
@@ -706,7 +838,7 @@ kill(int pid)
         acquire(&kt->klock);
         if(kt->kstate == KSLEEPING){
           // Wake thread from sleep().
-           kt->kstate = KRUNNABLE;
+           kthread_setstate(kt, KRUNNABLE);
         }
         release(&kt->klock);
       }
@@ -812,9 +944,11 @@ int kthread_create(void *(*start_func)(), uint64 stack, uint64 stack_size)
   *kt->trapframe = *mykthread()->trapframe;
   kt->trapframe->epc = (uint64) start_func;
   kt->trapframe->sp = stack + stack_size;
+  // user space finds its per-thread data by the kthread's slot.
+  kt->trapframe->tp = kt - myproc()->kthread;
 
 
-  kt->kstate = KRUNNABLE;  
+  kthread_setstate(kt, KRUNNABLE);
     
   release(&kt->klock);
 
@@ -848,7 +982,7 @@ int kthread_kill(int ktid)
             kt->kkilled = 1;
             if(kt->kstate == KSLEEPING){
               // Wake thread from sleep().
-              kt->kstate = KRUNNABLE;
+              kthread_setstate(kt, KRUNNABLE);
             }
             release(&kt->klock);
         }
@@ -868,7 +1002,7 @@ void kthread_exit(int status)
   
   acquire(&kt->klock);
   
-  kt->kstate = KZOMBIE;
+  kthread_setstate(kt, KZOMBIE);
   kt->kxstate = status;
   
   
@@ -906,6 +1040,8 @@ int kthread_join(int ktid, int* status)
             return -1;
           }
 
+        // reaped: the slot can take a new kthread.
+        freekthread(kt);
         release(&kt->klock);
         release(&myproc()->lock);
         release(&wait_lock);
@@ -928,4 +1064,87 @@ kthread_killed(struct kthread *kt)
   k = kt->kkilled;
   release(&kt->klock);
   return k;
-}
\ No newline at end of file
+}
+// Ask for handler to be called every ticks timer ticks that the
+// calling kthread spends running in user space. ticks == 0 disables.
+int
+kthread_sigalarm(int ticks, uint64 handler)
+{
+  struct kthread *kt = mykthread();
+
+  if(ticks < 0)
+    return -1;
+  kt->alarm_interval = ticks;
+  kt->alarm_ticks = 0;
+  kt->alarm_handler = handler;
+  return 0;
+}
+
+// Resume the user context that alarmtick() saved at frame.
+// Returns the interrupted a0, so that syscall() leaves it unchanged.
+// With no frame to resume, the handler would return to address 0,
+// so the process is killed, as for a bad trap.
+uint64
+kthread_sigreturn(uint64 frame)
+{
+  struct kthread *kt = mykthread();
+  struct trapframe saved;
+
+  if(copyin(myproc()->pagetable, (char *)&saved, frame, sizeof(saved)) < 0){
+    setkilled(myproc());
+    return -1;
+  }
+
+  // the kernel_* fields belong to this hart, not to the saved context.
+  saved.kernel_satp = kt->trapframe->kernel_satp;
+  saved.kernel_sp = kt->trapframe->kernel_sp;
+  saved.kernel_trap = kt->trapframe->kernel_trap;
+  saved.kernel_hartid = kt->trapframe->kernel_hartid;
+  *kt->trapframe = saved;
+  return kt->trapframe->a0;
+}
+
+// Copy the accounting of every live kthread of process pid, and the
+// process total, to the struct thread_stats at user address addr.
+int
+kthread_stats(int pid, uint64 addr)
+{
+  struct thread_stats st;
+  struct kthread_stat *ts;
+  struct kthread *kt;
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED)
+      goto found;
+    release(&p->lock);
+  }
+  return -1;
+
+found:
+  // with every klock held no kthread changes state, so the total
+  // and the threads are read at one instant and the total covers
+  // them exactly.
+  for(kt = p->kthread; kt < &p->kthread[NKT]; kt++)
+    acquire(&kt->klock);
+  memset(&st, 0, sizeof(st));
+  st.total = p->total;
+  for(kt = p->kthread; kt < &p->kthread[NKT]; kt++){
+    if(kt->kstate == KUNUSED)
+      continue;
+    ts = &st.thread[st.nthreads++];
+    kthread_getstat(kt, ts);
+    // the total only holds time charged at past state changes.
+    st.total.run_time += ts->run_time - kt->stat.run_time;
+    st.total.wait_time += ts->wait_time - kt->stat.wait_time;
+    st.total.sleep_time += ts->sleep_time - kt->stat.sleep_time;
+    if(ts->last_cpu >= 0)
+      st.total.last_cpu = ts->last_cpu;
+  }
+  for(kt = p->kthread; kt < &p->kthread[NKT]; kt++)
+    release(&kt->klock);
+  release(&p->lock);
+
+  return copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st));
+}
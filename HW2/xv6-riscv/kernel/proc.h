@@ -1,3 +1,4 @@
+#include "tstat.h"
 #include "kthread.h"
 
 
@@ -16,6 +17,7 @@ struct proc {
   enum procstate state;        // Process state
   //void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
+  int gang;                    // If non-zero, kthreads are gang scheduled (read unlocked as a hint)
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
 
@@ -33,5 +35,7 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+
+  struct kthread_stat total;   // sum of the kthreads' accounting, updated atomically
   
 };
@@ -29,8 +29,10 @@ acquire(struct spinlock *lk)
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
+  // interrupts are off while spinning, so carry out the TLB
+  // flushes other harts wait for (ipi.c). The holder may be one.
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+    ipiintr();
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
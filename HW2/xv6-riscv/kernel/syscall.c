@@ -106,6 +106,14 @@ extern uint64 sys_kthread_id(void);
 extern uint64 sys_kthread_kill(void);
 extern uint64 sys_kthread_exit(void);
 extern uint64 sys_kthread_join(void);
+extern uint64 sys_sigalarm(void);
+extern uint64 sys_sigreturn(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_getncpu(void);
+extern uint64 sys_kthread_stats(void);
+extern uint64 sys_gangsched(void);
+extern uint64 sys_sbrkeager(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -136,6 +144,14 @@ static uint64 (*syscalls[])(void) = {
 [SYS_kthread_kill]   sys_kthread_kill,
 [SYS_kthread_exit]   sys_kthread_exit,
 [SYS_kthread_join]   sys_kthread_join,
+[SYS_sigalarm]   sys_sigalarm,
+[SYS_sigreturn]   sys_sigreturn,
+[SYS_fcntl]   sys_fcntl,
+[SYS_poll]   sys_poll,
+[SYS_getncpu]   sys_getncpu,
+[SYS_kthread_stats]   sys_kthread_stats,
+[SYS_gangsched]   sys_gangsched,
+[SYS_sbrkeager]   sys_sbrkeager,
 };
 
 void
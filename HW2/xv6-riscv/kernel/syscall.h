@@ -25,3 +25,11 @@
 #define SYS_kthread_kill  24
 #define SYS_kthread_exit  25
 #define SYS_kthread_join  26
+#define SYS_sigalarm  27
+#define SYS_sigreturn  28
+#define SYS_fcntl  29
+#define SYS_poll  30
+#define SYS_getncpu  31
+#define SYS_kthread_stats  32
+#define SYS_gangsched  33
+#define SYS_sbrkeager  34
@@ -359,6 +359,7 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
@@ -503,3 +504,37 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// F_GETFL returns the O_NONBLOCK status of a file,
+// F_SETFL sets it from arg.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  argint(1, &cmd);
+  argint(2, &arg);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  switch(cmd){
+  case F_GETFL:
+    return f->nonblock ? O_NONBLOCK : 0;
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
+uint64
+sys_poll(void)
+{
+  uint64 fds;
+  int nfds, timeout;
+
+  argaddr(0, &fds);
+  argint(1, &nfds);
+  argint(2, &timeout);
+  return filepollwait(fds, nfds, timeout);
+}
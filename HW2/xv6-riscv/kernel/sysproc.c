@@ -35,19 +35,34 @@ sys_wait(void)
   return wait(p);
 }
 
-uint64
-sys_sbrk(void)
+// sbrk() leaves the pages it adds for the first touch to map;
+// sbrkeager() maps them at once, for callers that would rather
+// not take the faults.
+static uint64
+dosbrk(int eager)
 {
   uint64 addr;
   int n;
 
   argint(0, &n);
   addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if(growproc(n, eager) < 0)
     return -1;
   return addr;
 }
 
+uint64
+sys_sbrk(void)
+{
+  return dosbrk(0);
+}
+
+uint64
+sys_sbrkeager(void)
+{
+  return dosbrk(1);
+}
+
 uint64
 sys_sleep(void)
 {
@@ -134,4 +149,45 @@ uint64 sys_kthread_join(void)
   argint(0, &pid);
   argaddr(1, &p);
   return kthread_join(pid, (int*)p);
-}
\ No newline at end of file
+}
+uint64 sys_sigalarm(void)
+{
+  int ticks;
+  uint64 handler;
+
+  argint(0, &ticks);
+  argaddr(1, &handler);
+  return kthread_sigalarm(ticks, handler);
+}
+
+uint64 sys_sigreturn(void)
+{
+  uint64 frame;
+
+  argaddr(0, &frame);
+  return kthread_sigreturn(frame);
+}
+
+// number of harts running the kernel.
+uint64 sys_getncpu(void)
+{
+  return ncpu_online;
+}
+
+uint64 sys_kthread_stats(void)
+{
+  int pid;
+  uint64 st;
+
+  argint(0, &pid);
+  argaddr(1, &st);
+  return kthread_stats(pid, st);
+}
+
+uint64 sys_gangsched(void)
+{
+  int on;
+
+  argint(0, &on);
+  return gangsched(on);
+}
@@ -16,6 +16,8 @@ void kernelvec();
 
 extern int devintr();
 
+extern uint64 timer_scratch[NCPU][7]; // start.c
+
 void
 trapinit(void)
 {
@@ -70,6 +72,11 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 15 && uvmcow(p->pagetable, r_stval()) == 0){
+    // a store to a copy-on-write page, which is writable now.
+  } else if((r_scause() == 13 || r_scause() == 15) &&
+            uvmlazy(p->pagetable, r_stval(), p->sz) == 0){
+    // the first touch of a page sbrk() left unmapped.
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -88,12 +95,40 @@ usertrap(void)
   
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  if(which_dev == 2){
+    alarmtick(kt);
     yield();
+  }
 
   usertrapret();
 }
 
+// Charge a timer tick to kt, and once its sigalarm() interval has
+// elapsed redirect it to the handler. The interrupted registers are
+// pushed on the user stack and their address is passed in a0, so the
+// handler may switch to other user-level threads before it calls
+// sigreturn(frame); a fresh frame is pushed for every upcall.
+void
+alarmtick(struct kthread *kt)
+{
+  struct trapframe *tf = kt->trapframe;
+  uint64 sp;
+
+  if(kt->alarm_interval == 0 || ++kt->alarm_ticks < kt->alarm_interval)
+    return;
+  kt->alarm_ticks = 0;
+
+  sp = (tf->sp - sizeof(struct trapframe)) & ~0xfL;
+  if(copyout(kt->kproc->pagetable, sp, (char *)tf, sizeof(*tf)) < 0){
+    // no room on the user stack; drop this upcall.
+    return;
+  }
+  tf->sp = sp;
+  tf->a0 = sp;
+  tf->ra = 0;  // the handler must end in sigreturn()
+  tf->epc = kt->alarm_handler;
+}
+
 //
 // return to user space
 //
@@ -186,6 +221,7 @@ clockintr()
   ticks++;
   wakeup(&ticks);
   release(&tickslock);
+  pollwakeup();  // for poll() timeouts
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -221,17 +257,23 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or an IPI, forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
+    ipiintr();
+
+    // only a timer interrupt sets the tick flag.
+    if(__sync_lock_test_and_set(&timer_scratch[cpuid()][5], 0) == 0)
+      return 1;
+
+    if(cpuid() == 0){
+      clockintr();
+    }
+
     return 2;
   } else {
     return 0;
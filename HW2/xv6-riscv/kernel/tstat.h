@@ -0,0 +1,19 @@
+// Per-kthread CPU accounting, returned by kthread_stats().
+// Times are in timer cycles (the time CSR, 10MHz under qemu),
+// charged to a state when a kthread leaves it.
+struct kthread_stat {
+  int kid;              // 0 in a process total
+  int state;            // enum kthreadstate
+  int last_cpu;         // hart it last ran on, -1 if never
+  uint64 run_time;      // KRUNNING
+  uint64 wait_time;     // KRUNNABLE, waiting for a hart
+  uint64 sleep_time;    // KSLEEPING
+  uint64 nvcsw;         // voluntary switches: sleep or exit
+  uint64 nivcsw;        // involuntary switches: preempted
+};
+
+struct thread_stats {
+  int nthreads;                     // valid entries in thread[]
+  struct kthread_stat total;        // whole process, exited threads too
+  struct kthread_stat thread[NKT];
+};
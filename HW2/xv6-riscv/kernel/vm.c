@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -11,6 +13,10 @@
  */
 pagetable_t kernel_pagetable;
 
+// serializes the page faults of a process's kthreads, copy-on-write
+// and lazy, with each other and with the sharing of pages by fork.
+struct spinlock fault_lock;
+
 extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
@@ -33,6 +39,9 @@ kvmmake(void)
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
+  // CLINT, for sending IPIs through the msip registers
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
@@ -54,6 +63,7 @@ void
 kvminit(void)
 {
   kernel_pagetable = kvmmake();
+  initlock(&fault_lock, "fault");
 }
 
 // Switch h/w page table register to the kernel's page table,
@@ -165,30 +175,42 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages sbrk() left unmapped are skipped.
 // Optionally free the physical memory.
+// Other harts running pagetable may still hold the old translations,
+// so pages are only freed after a TLB shootdown, which is done once
+// per NUNMAPBATCH pages rather than once per page.
+#define NUNMAPBATCH 32
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
   uint64 a;
   pte_t *pte;
+  uint64 batch[NUNMAPBATCH];
+  int n = 0;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+    if((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
-      uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+      batch[n++] = PTE2PA(*pte);
     }
     *pte = 0;
+    if(n == NUNMAPBATCH){
+      tlbshootdown(pagetable);
+      while(n > 0)
+        kfree((void*)batch[--n]);
+    }
   }
+  if(npages > 0)
+    tlbshootdown(pagetable);
+  while(n > 0)
+    kfree((void*)batch[--n]);
 }
 
 // create an empty user page table.
@@ -298,8 +320,14 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// The physical pages are shared, not copied:
+// writable ones become read-only copy-on-write
+// in both page tables, and the first store to
+// one copies it (uvmcow()). The old page
+// table's stale writable TLB entries are shot
+// down before fault_lock is released, or a
+// sibling kthread could store through one
+// into a page that uvmcow() has just copied.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
@@ -308,30 +336,130 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   pte_t *pte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
+  acquire(&fault_lock);
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+    if((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;  // not touched since sbrk()
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
-      goto err;
-    }
+    krefinc((void*)pa);
   }
+  tlbshootdown(old);
+  release(&fault_lock);
   return 0;
 
  err:
+  tlbshootdown(old);
+  release(&fault_lock);
   uvmunmap(new, 0, i / PGSIZE, 1);
   return -1;
 }
 
+// Give the copy-on-write page at va a copy of its own, or
+// take the page over if nothing else shares it any more,
+// and make it writable. Returns 0 if it is, -1 if va is
+// not a copy-on-write page or there's no memory for a copy.
+// Other kthreads of the process may fault on the same page
+// at once, or still map the shared page in their TLBs.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  acquire(&fault_lock);
+  if((pte = walk(pagetable, va, 0)) == 0 ||
+     (*pte & (PTE_V | PTE_U)) != (PTE_V | PTE_U)){
+    release(&fault_lock);
+    return -1;
+  }
+  if(*pte & PTE_W){
+    // another kthread got here first.
+    release(&fault_lock);
+    sfence_vma();
+    return 0;
+  }
+  if((*pte & PTE_COW) == 0){
+    release(&fault_lock);
+    return -1;
+  }
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(krefcount((void*)pa) == 1){
+    // stale read-only translations just fault once more.
+    *pte = PA2PTE(pa) | flags;
+    release(&fault_lock);
+    sfence_vma();
+    return 0;
+  }
+  if((mem = kalloc()) == 0){
+    release(&fault_lock);
+    return -1;
+  }
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  tlbshootdown(pagetable);
+  release(&fault_lock);
+  kfree((void*)pa);
+  return 0;
+}
+
+// Map a zeroed page at va, which sbrk() left for the first touch
+// to map. Returns 0 if it is mapped, -1 if va is past sz or mapped
+// already, or there's no memory. Another kthread may map it first.
+int
+uvmlazy(pagetable_t pagetable, uint64 va, uint64 sz)
+{
+  pte_t *pte;
+  char *mem;
+
+  if(va >= sz)
+    return -1;
+  va = PGROUNDDOWN(va);
+  acquire(&fault_lock);
+  if((pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_V)){
+    // another kthread mapped it first, or it isn't lazy.
+    release(&fault_lock);
+    return (*pte & PTE_U) && (*pte & PTE_W) ? 0 : -1;
+  }
+  if((mem = kalloc()) == 0){
+    release(&fault_lock);
+    return -1;
+  }
+  memset(mem, 0, PGSIZE);
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_R|PTE_W|PTE_U) != 0){
+    release(&fault_lock);
+    kfree(mem);
+    return -1;
+  }
+  release(&fault_lock);
+  return 0;
+}
+
+// walkaddr() for copyin() and copyout(), which also maps a page
+// of the current process that sbrk() left for the first touch.
+static uint64
+uwalkaddr(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+
+  if((pa = walkaddr(pagetable, va)) == 0 && p != 0 &&
+     pagetable == p->pagetable && uvmlazy(pagetable, va, p->sz) == 0)
+    pa = walkaddr(pagetable, va);
+  return pa;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -352,10 +480,16 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    if(va0 >= MAXVA)
+      return -1;
+    if((pte = walk(pagetable, va0, 0)) != 0 && (*pte & PTE_COW) &&
+       uvmcow(pagetable, va0) < 0)
+      return -1;
+    pa0 = uwalkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -380,7 +514,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uwalkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -407,7 +541,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uwalkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -0,0 +1,172 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/tpool.h"
+
+// Parallel sum and merge sort on the work-stealing pool, for 1 up to
+// one worker per hart. Run under different CPUS= to see the speedup:
+//   parbench [n] [rounds]
+
+#define SUM_GRAIN   4096
+#define SORT_CUTOFF 2048
+
+int *data;
+int *sorted;
+int *tmp;
+
+long
+sum_range(int lo, int hi, void *arg)
+{
+  long s = 0;
+  for(int i = lo; i < hi; i++)
+    s += data[i];
+  return s;
+}
+
+long
+add(long a, long b)
+{
+  return a + b;
+}
+
+void
+merge(int *a, int na, int *b, int nb, int *out)
+{
+  int i = 0, j = 0, k = 0;
+  while(i < na && j < nb)
+    out[k++] = a[i] <= b[j] ? a[i++] : b[j++];
+  while(i < na)
+    out[k++] = a[i++];
+  while(j < nb)
+    out[k++] = b[j++];
+}
+
+// sorts a[0..n) using t[0..n) as scratch.
+void
+serial_sort(int *a, int *t, int n)
+{
+  int h = n / 2;
+
+  if(n <= 16){
+    for(int i = 1; i < n; i++){
+      int x = a[i], j = i;
+      for(; j > 0 && a[j-1] > x; j--)
+        a[j] = a[j-1];
+      a[j] = x;
+    }
+    return;
+  }
+  serial_sort(a, t, h);
+  serial_sort(a + h, t + h, n - h);
+  merge(a, h, a + h, n - h, t);
+  memmove(a, t, n * sizeof(int));
+}
+
+struct sortarg {
+  int *a;
+  int *t;
+  int n;
+};
+
+void
+parallel_sort(void *arg)
+{
+  struct sortarg *s = arg;
+  struct sortarg lower, upper;
+  struct task_group g = { 0 };
+  struct task t;
+  int h = s->n / 2;
+
+  if(s->n <= SORT_CUTOFF){
+    serial_sort(s->a, s->t, s->n);
+    return;
+  }
+  lower.a = s->a;
+  lower.t = s->t;
+  lower.n = h;
+  upper.a = s->a + h;
+  upper.t = s->t + h;
+  upper.n = s->n - h;
+  task_spawn(&g, &t, parallel_sort, &upper);
+  parallel_sort(&lower);
+  task_sync(&g);
+  merge(s->a, h, s->a + h, s->n - h, s->t);
+  memmove(s->a, s->t, s->n * sizeof(int));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 1 << 18, rounds = 20;
+  int ncpu = getncpu();
+  int sum_base = 0, sort_base = 0;
+  uint seed = 1;
+  long expect = 0;
+  struct sortarg s;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    rounds = atoi(argv[2]);
+
+  data = malloc(n * sizeof(int));
+  sorted = malloc(n * sizeof(int));
+  tmp = malloc(n * sizeof(int));
+  if(data == 0 || sorted == 0 || tmp == 0){
+    printf("parbench: out of memory\n");
+    exit(1);
+  }
+  for(int i = 0; i < n; i++){
+    seed = seed * 1103515245 + 12345;
+    data[i] = (seed >> 8) & 0xffff;
+    expect += data[i];
+  }
+
+  printf("# parbench n=%d rounds=%d harts=%d\n", n, rounds, ncpu);
+  printf("workers\tsum_ticks\tsum_speedup_x100\tsort_ticks\tsort_speedup_x100\n");
+  for(int w = 1; w <= ncpu; w++){
+    if(tpool_init(w) != w){
+      printf("parbench: tpool_init(%d) failed\n", w);
+      exit(1);
+    }
+
+    int t0 = uptime();
+    for(int r = 0; r < rounds; r++){
+      if(parallel_reduce(0, n, SUM_GRAIN, 0, sum_range, add, 0) != expect){
+        printf("parbench: wrong sum\n");
+        exit(1);
+      }
+    }
+    int sum_ticks = uptime() - t0;
+
+    int sort_ticks = 0;
+    for(int r = 0; r < rounds / 4 + 1; r++){
+      memmove(sorted, data, n * sizeof(int));
+      s.a = sorted;
+      s.t = tmp;
+      s.n = n;
+      t0 = uptime();
+      tpool_run(parallel_sort, &s);
+      sort_ticks += uptime() - t0;
+    }
+    for(int i = 1; i < n; i++){
+      if(sorted[i-1] > sorted[i]){
+        printf("parbench: not sorted\n");
+        exit(1);
+      }
+    }
+    tpool_shutdown();
+
+    if(sum_ticks == 0)
+      sum_ticks = 1;
+    if(sort_ticks == 0)
+      sort_ticks = 1;
+    if(w == 1){
+      sum_base = sum_ticks;
+      sort_base = sort_ticks;
+    }
+    printf("%d\t%d\t%d\t%d\t%d\n", w, sum_ticks, sum_base * 100 / sum_ticks,
+           sort_ticks, sort_base * 100 / sort_ticks);
+  }
+  exit(0);
+}
@@ -0,0 +1,393 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+// Threading microbenchmarks. Prints one tab-separated row per result:
+//   bench  threads  cpus  value  unit
+// so that runs of different builds can be diffed. Run under several
+// CPUS= settings to sweep the hart count. With gang, only times the
+// barrier with and without gang scheduling while one spinning
+// process per hart competes for the harts:
+//   threadbench [gang] [iterations]
+
+#define NS_PER_CYCLE  100        // qemu virt's time CSR runs at 10MHz
+#define STACK         4096
+#define MAXT          (NKT - 1)  // kthreads besides main
+
+int ncpu;
+int iters = 2000;
+
+char *stacks[MAXT];
+volatile int go;
+volatile int nready;
+
+static inline uint64
+now(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+void
+report(char *bench, int threads, uint64 value, char *unit)
+{
+  printf("%s\t%d\t%d\t%l\t%s\n", bench, threads, ncpu, value, unit);
+}
+
+// start n kthreads at fn and wait until all of them are running.
+void
+start_threads(int n, void (*fn)(void), int *kids)
+{
+  nready = 0;
+  go = 0;
+  for(int i = 0; i < n; i++){
+    kids[i] = kthread_create((void *(*)())fn, (uint64)stacks[i], STACK);
+    if(kids[i] <= 0){
+      printf("threadbench: kthread_create failed\n");
+      exit(1);
+    }
+  }
+  while(nready < n)
+    ;
+}
+
+void
+join_threads(int n, int *kids)
+{
+  for(int i = 0; i < n; i++)
+    kthread_join(kids[i], 0);
+}
+
+// --- kthread create + join ---
+
+void
+empty_thread(void)
+{
+  kthread_exit(0);
+}
+
+void
+bench_create_join(void)
+{
+  int kid;
+  uint64 t0 = now();
+
+  for(int i = 0; i < iters; i++){
+    kid = kthread_create((void *(*)())empty_thread, (uint64)stacks[0], STACK);
+    if(kid <= 0 || kthread_join(kid, 0) != 0){
+      printf("threadbench: create/join failed\n");
+      exit(1);
+    }
+  }
+  report("kthread_create_join", 1, (now() - t0) * NS_PER_CYCLE / iters, "ns");
+}
+
+// --- kthread to kthread wakeup over a pipe ping-pong ---
+
+int ping[2], pong[2];
+
+void
+pong_thread(void)
+{
+  char c;
+
+  __sync_fetch_and_add(&nready, 1);
+  for(int i = 0; i < iters; i++){
+    read(ping[0], &c, 1);
+    write(pong[1], &c, 1);
+  }
+  kthread_exit(0);
+}
+
+void
+bench_wakeup(void)
+{
+  int kid;
+  char c = 'x';
+  uint64 t0;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("threadbench: pipe failed\n");
+    exit(1);
+  }
+  start_threads(1, pong_thread, &kid);
+  t0 = now();
+  for(int i = 0; i < iters; i++){
+    write(ping[1], &c, 1);
+    read(pong[0], &c, 1);
+  }
+  // two wakeups per round trip.
+  report("kthread_wakeup", 2, (now() - t0) * NS_PER_CYCLE / (2 * iters), "ns");
+  join_threads(1, &kid);
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+}
+
+// --- contended spinlock ---
+
+volatile int lock;
+volatile uint64 counter;
+volatile int nthreads;
+
+void
+lock_thread(void)
+{
+  __sync_fetch_and_add(&nready, 1);
+  while(!go)
+    ;
+  for(int i = 0; i < iters; i++){
+    while(__sync_lock_test_and_set(&lock, 1) != 0)
+      while(lock)
+        ;
+    counter++;
+    __sync_lock_release(&lock);
+  }
+  kthread_exit(0);
+}
+
+void
+bench_lock(int n)
+{
+  int kids[MAXT];
+  uint64 t0, t;
+
+  counter = 0;
+  start_threads(n, lock_thread, kids);
+  t0 = now();
+  go = 1;
+  join_threads(n, kids);
+  t = now() - t0;
+  if(counter != (uint64)n * iters){
+    printf("threadbench: lock lost updates\n");
+    exit(1);
+  }
+  report("lock_acquire_release", n, t * NS_PER_CYCLE / (n * iters), "ns");
+}
+
+// --- sense-reversing barrier ---
+
+volatile int barrier_count;
+volatile int barrier_sense;
+
+void
+barrier_wait(int *local_sense)
+{
+  *local_sense = !*local_sense;
+  if(__sync_add_and_fetch(&barrier_count, 1) == nthreads){
+    barrier_count = 0;
+    __sync_synchronize();
+    barrier_sense = *local_sense;
+  } else {
+    while(barrier_sense != *local_sense)
+      ;
+  }
+}
+
+void
+barrier_thread(void)
+{
+  int sense = 0;
+
+  __sync_fetch_and_add(&nready, 1);
+  while(!go)
+    ;
+  for(int i = 0; i < iters; i++)
+    barrier_wait(&sense);
+  kthread_exit(0);
+}
+
+void
+bench_barrier(int n, char *name)
+{
+  int kids[MAXT];
+  uint64 t0;
+
+  nthreads = n;
+  barrier_count = 0;
+  barrier_sense = 0;
+  start_threads(n, barrier_thread, kids);
+  t0 = now();
+  go = 1;
+  join_threads(n, kids);
+  report(name, n, (now() - t0) * NS_PER_CYCLE / iters, "ns");
+}
+
+void
+bench_gang(void)
+{
+  int hogs[NCPU];
+  int n = ncpu < MAXT ? ncpu : MAXT;
+
+  for(int i = 0; i < ncpu; i++){
+    if((hogs[i] = fork()) == 0)
+      for(;;)
+        ;
+  }
+  gangsched(0);
+  bench_barrier(n, "barrier_loaded");
+  gangsched(1);
+  bench_barrier(n, "barrier_loaded_gang");
+  gangsched(0);
+  for(int i = 0; i < ncpu; i++){
+    kill(hogs[i]);
+    wait(0);
+  }
+}
+
+// --- malloc/free from every thread at once ---
+
+#define NLIVE 16
+
+void
+malloc_thread(void)
+{
+  char *p[NLIVE];
+
+  __sync_fetch_and_add(&nready, 1);
+  while(!go)
+    ;
+  for(int i = 0; i < iters; i++){
+    for(int j = 0; j < NLIVE; j++){
+      if((p[j] = malloc(16 << (j % 8))) == 0){
+        printf("threadbench: malloc failed\n");
+        exit(1);
+      }
+      p[j][0] = j;
+    }
+    for(int j = 0; j < NLIVE; j++){
+      if(p[j][0] != j){
+        printf("threadbench: malloc block overlap\n");
+        exit(1);
+      }
+      free(p[j]);
+    }
+  }
+  kthread_exit(0);
+}
+
+void
+bench_malloc(int n)
+{
+  int kids[MAXT];
+  uint64 t0;
+
+  start_threads(n, malloc_thread, kids);
+  t0 = now();
+  go = 1;
+  join_threads(n, kids);
+  // malloc+free pairs per millisecond, summed over the threads.
+  report("malloc_free", n, (uint64)n * iters * NLIVE * 1000000 / ((now() - t0) * NS_PER_CYCLE), "ops/ms");
+}
+
+// --- uthreads, in a child since uthread_start_all() never returns ---
+
+struct context ctx_a, ctx_b;
+char *uswtch_stack;
+
+void
+uswtch_partner(void)
+{
+  for(;;)
+    uswtch(&ctx_b, &ctx_a);
+}
+
+void
+noop_thread(void)
+{
+  uthread_exit();
+}
+
+// two of these yield to each other; the first starts the clock
+// and the last one to finish stops it.
+uint64 yield_t0;
+int yield_done;
+
+void
+yield_thread(void)
+{
+  if(yield_t0 == 0)
+    yield_t0 = now();
+  for(int i = 0; i < iters; i++)
+    uthread_yield();
+  if(++yield_done == 2)
+    report("uthread_yield", 2, (now() - yield_t0) * NS_PER_CYCLE / (2 * iters), "ns");
+  uthread_exit();
+}
+
+void
+bench_uthreads(void)
+{
+  uint64 t0;
+  char *brk0;
+  int n = 1000;
+
+  // bare uswtch() ping-pong between two contexts.
+  uswtch_stack = malloc(STACK);
+  memset(&ctx_b, 0, sizeof(ctx_b));
+  ctx_b.ra = (uint64)uswtch_partner;
+  ctx_b.sp = (uint64)uswtch_stack + STACK;
+  t0 = now();
+  for(int i = 0; i < iters; i++)
+    uswtch(&ctx_a, &ctx_b);
+  report("uswtch", 1, (now() - t0) * NS_PER_CYCLE / (2 * iters), "ns");
+
+  // memory per uthread: descriptor plus a pooled default stack.
+  brk0 = sbrk(0);
+  t0 = now();
+  for(int i = 0; i < n; i++)
+    uthread_create(noop_thread, LOW);
+  report("uthread_create", n, (now() - t0) * NS_PER_CYCLE / n, "ns");
+  report("uthread_mem", n, (sbrk(0) - brk0) / n, "bytes");
+
+  // the no-op threads run and exit first, then these two.
+  uthread_create(yield_thread, LOW);
+  uthread_create(yield_thread, LOW);
+  uthread_start_all();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, gang = 0;
+
+  if(argc > 1 && strcmp(argv[1], "gang") == 0){
+    // each loaded barrier round waits for the hogs' time slices.
+    gang = 1;
+    iters = 100;
+    argc--;
+    argv++;
+  }
+  if(argc > 1)
+    iters = atoi(argv[1]);
+  ncpu = getncpu();
+  for(int i = 0; i < MAXT; i++)
+    stacks[i] = malloc(STACK);
+
+  printf("# threadbench iters=%d%s\n", iters, gang ? " gang" : "");
+  printf("bench\tthreads\tcpus\tvalue\tunit\n");
+  if(gang){
+    bench_gang();
+    exit(0);
+  }
+
+  bench_create_join();
+  bench_wakeup();
+  for(int n = 1; n <= MAXT; n *= 2)
+    bench_lock(n);
+  for(int n = 1; n <= MAXT; n *= 2)
+    bench_barrier(n, "barrier");
+  for(int n = 1; n <= MAXT; n *= 2)
+    bench_malloc(n);
+
+  if((pid = fork()) == 0){
+    bench_uthreads();
+    exit(0);
+  }
+  wait(0);
+  exit(0);
+}
@@ -0,0 +1,359 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+#include "user/uthread.h"
+#include "user/tpool.h"
+
+// Chase-Lev work-stealing deque. The owner pushes and pops at bottom
+// without locks; thieves take from top with a compare-and-swap, and
+// only the last task is contended between owner and thieves.
+struct deque {
+  long top;
+  char pad[56];                  // keep thieves' top off the owner's line
+  long bottom;
+  struct task *buf[DEQUE_SIZE];
+};
+
+struct worker {
+  struct deque dq;
+  int kid;                       // kthread id, 0 for worker 0 (the caller)
+  char *stack;                   // TPOOL_STACK_SIZE bytes
+  uint seed;                     // xorshift state for picking victims
+};
+
+#define IDLE_SPINS  100000       // failed steal rounds before a worker sleeps
+
+static struct worker *workers;
+static int nworkers;
+static volatile int shutting_down;
+static int nstarted;
+
+// Worker 0 runs parallel work on its own pool stack, since the main
+// thread's stack is a single page. tpool_run() switches to it.
+static struct context main_context;
+static struct context pool_context;
+static int on_pool_stack;
+static void (*run_fn)(void *);
+static void *run_arg;
+
+// Worker index of each kthread slot. The kernel starts every kthread
+// with its slot in the process (0..NKT-1) in tp.
+static int worker_of[NKT];
+
+static inline int
+self(void)
+{
+  uint64 slot;
+  asm volatile("mv %0, tp" : "=r" (slot));
+  return worker_of[slot];
+}
+
+static inline void
+set_self(int id)
+{
+  uint64 slot;
+  asm volatile("mv %0, tp" : "=r" (slot));
+  worker_of[slot] = id;
+}
+
+static int
+deque_push(struct deque *d, struct task *t)
+{
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+  if(b - top >= DEQUE_SIZE)
+    return -1;
+  __atomic_store_n(&d->buf[b % DEQUE_SIZE], t, __ATOMIC_RELAXED);
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static struct task*
+deque_pop(struct deque *d)
+{
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+  long top;
+  struct task *t = 0;
+
+  __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+  if(top <= b){
+    t = __atomic_load_n(&d->buf[b % DEQUE_SIZE], __ATOMIC_RELAXED);
+    if(top == b){
+      // last task: race the thieves for it.
+      if(!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        t = 0;
+      __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+  } else {
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return t;
+}
+
+static struct task*
+deque_steal(struct deque *d)
+{
+  long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  long b;
+  struct task *t;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+  if(top >= b)
+    return 0;
+  t = __atomic_load_n(&d->buf[top % DEQUE_SIZE], __ATOMIC_RELAXED);
+  if(!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+                                  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return 0;
+  return t;
+}
+
+// own deque first, then up to nworkers random victims.
+static struct task*
+find_task(int me)
+{
+  struct worker *w = &workers[me];
+  struct task *t;
+  int i, victim;
+
+  if((t = deque_pop(&w->dq)) != 0)
+    return t;
+  for(i = 0; i < nworkers; i++){
+    w->seed ^= w->seed << 13;
+    w->seed ^= w->seed >> 17;
+    w->seed ^= w->seed << 5;
+    victim = w->seed % nworkers;
+    if(victim != me && (t = deque_steal(&workers[victim].dq)) != 0)
+      return t;
+  }
+  return 0;
+}
+
+static void
+run_task(struct task *t)
+{
+  struct task_group *g = t->group;
+
+  t->fn(t->arg);
+  // t may be gone as soon as pending drops.
+  __atomic_sub_fetch(&g->pending, 1, __ATOMIC_RELEASE);
+}
+
+static void
+worker_main(void)
+{
+  int me = __atomic_add_fetch(&nstarted, 1, __ATOMIC_RELAXED);
+  struct task *t;
+  int idle = 0;
+
+  set_self(me);
+  while(!shutting_down){
+    if((t = find_task(me)) != 0){
+      run_task(t);
+      idle = 0;
+    } else if(++idle >= IDLE_SPINS){
+      sleep(1);
+      idle = 0;
+    }
+  }
+  kthread_exit(0);
+}
+
+int
+tpool_init(int n)
+{
+  int i;
+
+  if(nworkers > 0)
+    return -1;
+  if(n <= 0)
+    n = getncpu();
+  if(n > NKT)
+    n = NKT;
+  if(n < 1)
+    n = 1;
+
+  if((workers = malloc(n * sizeof(struct worker))) == 0)
+    return -1;
+  memset(workers, 0, n * sizeof(struct worker));
+  for(i = 0; i < n; i++){
+    workers[i].seed = 2463534242U + i * 7919;
+    if((workers[i].stack = malloc(TPOOL_STACK_SIZE)) == 0)
+      goto bad;
+  }
+
+  nworkers = n;
+  nstarted = 0;
+  shutting_down = 0;
+  set_self(0);
+  for(i = 1; i < n; i++){
+    workers[i].kid = kthread_create((void *(*)())worker_main,
+                                    (uint64)workers[i].stack, TPOOL_STACK_SIZE);
+    if(workers[i].kid <= 0){
+      nworkers = i;
+      tpool_shutdown();
+      return -1;
+    }
+  }
+  return n;
+
+bad:
+  for(i = 0; i < n; i++)
+    if(workers[i].stack)
+      free(workers[i].stack);
+  free(workers);
+  workers = 0;
+  return -1;
+}
+
+void
+tpool_shutdown(void)
+{
+  int i;
+
+  if(nworkers == 0)
+    return;
+  shutting_down = 1;
+  for(i = 1; i < nworkers; i++)
+    if(workers[i].kid > 0)
+      kthread_join(workers[i].kid, 0);
+  for(i = 0; i < nworkers; i++)
+    free(workers[i].stack);
+  free(workers);
+  workers = 0;
+  nworkers = 0;
+}
+
+int
+tpool_size(void)
+{
+  return nworkers;
+}
+
+int
+tpool_worker_id(void)
+{
+  return nworkers > 0 ? self() : 0;
+}
+
+void
+task_spawn(struct task_group *g, struct task *t, void (*fn)(void *), void *arg)
+{
+  t->fn = fn;
+  t->arg = arg;
+  t->group = g;
+  if(nworkers == 0){
+    fn(arg);
+    return;
+  }
+  __atomic_add_fetch(&g->pending, 1, __ATOMIC_RELAXED);
+  if(deque_push(&workers[self()].dq, t) < 0)
+    run_task(t);  // deque full: run it now
+}
+
+// Wait for g's tasks, running this and other workers' tasks meanwhile.
+void
+task_sync(struct task_group *g)
+{
+  struct task *t;
+  int me;
+
+  if(nworkers == 0)
+    return;
+  me = self();
+  while(__atomic_load_n(&g->pending, __ATOMIC_ACQUIRE) > 0){
+    if((t = find_task(me)) != 0)
+      run_task(t);
+  }
+}
+
+static void
+run_entry(void)
+{
+  run_fn(run_arg);
+  uswtch(&pool_context, &main_context);
+}
+
+// Call fn(arg) on worker 0's pool stack. Fork-join code started from
+// the main thread should go through here (parallel_* already do).
+void
+tpool_run(void (*fn)(void *), void *arg)
+{
+  if(nworkers == 0 || on_pool_stack || self() != 0){
+    fn(arg);
+    return;
+  }
+  run_fn = fn;
+  run_arg = arg;
+  memset(&pool_context, 0, sizeof(pool_context));
+  pool_context.ra = (uint64)run_entry;
+  pool_context.sp = (uint64)workers[0].stack + TPOOL_STACK_SIZE;
+  on_pool_stack = 1;
+  uswtch(&main_context, &pool_context);
+  on_pool_stack = 0;
+}
+
+struct range {
+  int lo, hi, grain;
+  void (*fn)(int, int, void *);
+  long (*rfn)(int, int, void *);
+  long (*combine)(long, long);
+  void *arg;
+  long result;
+};
+
+// split in halves, spawning the upper one, down to grain iterations.
+static void
+range_run(void *a)
+{
+  struct range *r = a;
+  struct range upper;
+  struct task_group g = { 0 };
+  struct task t;
+  int mid;
+
+  if(r->hi - r->lo <= r->grain){
+    if(r->rfn)
+      r->result = r->rfn(r->lo, r->hi, r->arg);
+    else
+      r->fn(r->lo, r->hi, r->arg);
+    return;
+  }
+  mid = r->lo + (r->hi - r->lo) / 2;
+  upper = *r;
+  upper.lo = mid;
+  r->hi = mid;
+  task_spawn(&g, &t, range_run, &upper);
+  range_run(r);
+  task_sync(&g);
+  if(r->rfn)
+    r->result = r->combine(r->result, upper.result);
+  r->hi = upper.hi;
+}
+
+void
+parallel_for(int lo, int hi, int grain, void (*fn)(int, int, void *), void *arg)
+{
+  struct range r = { lo, hi, grain > 0 ? grain : 1, fn, 0, 0, arg, 0 };
+
+  if(lo >= hi)
+    return;
+  tpool_run(range_run, &r);
+}
+
+long
+parallel_reduce(int lo, int hi, int grain, long identity,
+                long (*fn)(int, int, void *),
+                long (*combine)(long, long), void *arg)
+{
+  struct range r = { lo, hi, grain > 0 ? grain : 1, 0, fn, combine, arg, identity };
+
+  if(lo >= hi)
+    return identity;
+  tpool_run(range_run, &r);
+  return r.result;
+}
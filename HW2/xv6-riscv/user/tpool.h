@@ -0,0 +1,39 @@
+// Work-stealing fork-join runtime on top of kthreads.
+//
+// tpool_init() starts one worker kthread per hart; the calling thread
+// becomes worker 0 and runs tasks while it waits in task_sync().
+// Every worker owns a deque of spawned tasks. It pops its own tasks
+// LIFO and, when it runs dry, steals FIFO from a random other worker.
+
+#define TPOOL_STACK_SIZE  8192   // stack of each worker kthread
+#define DEQUE_SIZE        1024   // spawned, not yet started tasks per worker
+
+// A task and its group are owned by the caller of task_spawn(), usually
+// on its stack, and must stay alive until task_sync() on the group.
+struct task_group {
+  volatile int pending;          // spawned tasks not finished yet
+};
+
+struct task {
+  void (*fn)(void *arg);
+  void *arg;
+  struct task_group *group;
+};
+
+int tpool_init(int nworkers);    // nworkers <= 0: one per hart
+void tpool_shutdown(void);
+int tpool_size(void);
+int tpool_worker_id(void);       // 0 .. tpool_size()-1
+
+void tpool_run(void (*fn)(void *), void *arg);
+
+void task_spawn(struct task_group *g, struct task *t, void (*fn)(void *), void *arg);
+void task_sync(struct task_group *g);
+
+// Run fn over [lo, hi) in chunks of at most grain iterations.
+void parallel_for(int lo, int hi, int grain, void (*fn)(int lo, int hi, void *arg), void *arg);
+
+// Combine fn's results over [lo, hi) with the associative combine().
+long parallel_reduce(int lo, int hi, int grain, long identity,
+                     long (*fn)(int lo, int hi, void *arg),
+                     long (*combine)(long, long), void *arg);
@@ -0,0 +1,134 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/tstat.h"
+#include "user/user.h"
+
+// kthread_stats() while one kthread spins and another sleeps: the
+// spinner's run time grows and the timer preempts it, the sleeper
+// is charged mostly sleep time and a voluntary switch per sleep, and
+// the process total covers every live kthread, and keeps the time
+// of one that has exited.
+
+#define STACK   4096
+#define NSLEEP  5
+
+volatile int stop;
+volatile int slept;
+
+void
+fail(char *what)
+{
+  printf("tstat_test: %s\n", what);
+  exit(1);
+}
+
+void
+busy(void)
+{
+  while(!stop)
+    ;
+  kthread_exit(0);
+}
+
+void
+sleeper(void)
+{
+  for(int i = 0; i < NSLEEP; i++)
+    sleep(2);
+  slept = 1;
+  while(!stop)
+    sleep(1);
+  kthread_exit(0);
+}
+
+struct kthread_stat*
+find(struct thread_stats *st, int kid)
+{
+  for(int i = 0; i < st->nthreads; i++)
+    if(st->thread[i].kid == kid)
+      return &st->thread[i];
+  fail("kthread missing from its process's stats");
+  return 0;
+}
+
+void
+stats(struct thread_stats *st)
+{
+  if(kthread_stats(getpid(), st) < 0)
+    fail("kthread_stats failed");
+}
+
+// the total must cover the live kthreads of st.
+void
+check_total(struct thread_stats *st)
+{
+  struct kthread_stat sum;
+
+  memset(&sum, 0, sizeof(sum));
+  for(int i = 0; i < st->nthreads; i++){
+    sum.run_time += st->thread[i].run_time;
+    sum.wait_time += st->thread[i].wait_time;
+    sum.sleep_time += st->thread[i].sleep_time;
+    sum.nvcsw += st->thread[i].nvcsw;
+    sum.nivcsw += st->thread[i].nivcsw;
+  }
+  if(st->total.run_time < sum.run_time || st->total.wait_time < sum.wait_time ||
+     st->total.sleep_time < sum.sleep_time || st->total.nvcsw < sum.nvcsw ||
+     st->total.nivcsw < sum.nivcsw)
+    fail("process total short of its kthreads");
+}
+
+int
+main(int argc, char *argv[])
+{
+  static struct thread_stats s1, s2, s3;
+  struct kthread_stat *b1, *b2, *z;
+  int kb, kz;
+
+  if(kthread_stats(-1, &s1) >= 0)
+    fail("kthread_stats of no process succeeded");
+
+  kb = kthread_create((void *(*)())busy, (uint64)malloc(STACK), STACK);
+  kz = kthread_create((void *(*)())sleeper, (uint64)malloc(STACK), STACK);
+  if(kb <= 0 || kz <= 0)
+    fail("kthread_create failed");
+  while(!slept)
+    sleep(1);
+
+  stats(&s1);
+  sleep(5);
+  stats(&s2);
+  if(s1.nthreads != 3 || s2.nthreads != 3)
+    fail("wrong number of live kthreads");
+  check_total(&s1);
+  check_total(&s2);
+
+  b1 = find(&s1, kb);
+  b2 = find(&s2, kb);
+  if(b2->run_time <= b1->run_time)
+    fail("spinner's run time did not grow");
+  if(b2->nivcsw == 0)
+    fail("spinner never preempted");
+  if(b2->sleep_time >= b2->run_time)
+    fail("spinner charged with sleep");
+
+  z = find(&s2, kz);
+  if(z->nvcsw < NSLEEP)
+    fail("sleeper's sleeps not counted");
+  if(z->sleep_time <= z->run_time)
+    fail("sleeper charged with running");
+
+  stop = 1;
+  kthread_join(kb, 0);
+  kthread_join(kz, 0);
+  stats(&s3);
+  if(s3.nthreads != 1)
+    fail("joined kthreads still listed");
+  check_total(&s3);
+  if(s3.total.sleep_time < z->sleep_time || s3.total.run_time < b2->run_time)
+    fail("process total lost an exited kthread's time");
+
+  printf("tstat_test: OK\n");
+  exit(0);
+}
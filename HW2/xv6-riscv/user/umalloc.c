@@ -1,32 +1,165 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
+#include "user/uthread.h"
 #include "kernel/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Thread-safe memory allocator.
+//
+// Requests of up to MAXSMALL bytes are rounded up to one of NCLASS
+// power-of-two size classes. Every kthread keeps a cache of free
+// blocks per class and refills it in batches from the central bins,
+// which carve new blocks out of sbrk()ed slabs, so most malloc() and
+// free() calls touch only the calling kthread's cache. Larger
+// requests go to the first-fit allocator by Kernighan and Ritchie,
+// The C programming Language, 2nd ed.  Section 8.7, under its own lock.
+//
+// The kernel starts each kthread with its slot in the process in tp,
+// which picks its cache. A cache still has a lock, since preemptive
+// uthreads on one kthread share it, and a uthread holding any of the
+// locks is not preempted, or the next one could spin on it forever.
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *ptr;         // next free block
+    uint size;                 // large: size in Header units
+    int cls;                   // size class, or LARGE
   } s;
   Align x;
 };
 
 typedef union header Header;
 
+#define NCLASS    8            // 16, 32, ... 2048 bytes
+#define MINSMALL  16
+#define MAXSMALL  (MINSMALL << (NCLASS - 1))
+#define LARGE     -1
+#define BATCH     8192         // bytes moved per cache refill or flush
+#define SLAB      65536        // bytes sbrk()ed at a time for small blocks
+
+struct tcache {
+  int lock;
+  int count[NCLASS];
+  Header *bin[NCLASS];
+} __attribute__((aligned(64)));
+
+static struct tcache tcache[NKT];
+
+static struct {
+  int lock;
+  Header *bin[NCLASS];
+  char *slab, *slab_end;
+} central;
+
+static int large_lock;
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+static inline void
+lock(int *l)
 {
-  Header *bp, *p;
+  uthread_preempt_disable();
+  while(__sync_lock_test_and_set(l, 1) != 0)
+    while(*(volatile int *)l)
+      ;
+}
+
+static inline void
+unlock(int *l)
+{
+  __sync_lock_release(l);
+  uthread_preempt_enable();
+}
+
+static inline struct tcache*
+mycache(void)
+{
+  uint64 slot;
+
+  asm volatile("mv %0, tp" : "=r" (slot));
+  return &tcache[slot < NKT ? slot : 0];
+}
+
+static inline int
+size_class(uint nbytes)
+{
+  int c = 0;
+
+  while((MINSMALL << c) < nbytes)
+    c++;
+  return c;
+}
+
+// blocks moved between a cache and the central bins at a time.
+static inline int
+batch(int c)
+{
+  int n = BATCH / ((MINSMALL << c) + sizeof(Header));
+  return n < 2 ? 2 : n;
+}
+
+// Move up to n blocks of class c from the central bins, carving new
+// ones from the slab when the bin runs dry, into tc.
+static void
+refill(struct tcache *tc, int c, int n)
+{
+  uint bsize = (MINSMALL << c) + sizeof(Header);
+  Header *h;
+  char *p;
+
+  lock(&central.lock);
+  while(n > 0 && (h = central.bin[c]) != 0){
+    central.bin[c] = h->s.ptr;
+    h->s.ptr = tc->bin[c];
+    tc->bin[c] = h;
+    tc->count[c]++;
+    n--;
+  }
+  while(n > 0){
+    if(central.slab + bsize > central.slab_end){
+      // the tail of the old slab is too short for this class and is lost.
+      if((p = sbrk(SLAB)) == (char*)-1)
+        break;
+      central.slab = p;
+      central.slab_end = p + SLAB;
+    }
+    h = (Header*)central.slab;
+    central.slab += bsize;
+    h->s.cls = c;
+    h->s.ptr = tc->bin[c];
+    tc->bin[c] = h;
+    tc->count[c]++;
+    n--;
+  }
+  unlock(&central.lock);
+}
+
+// Give n blocks of class c from tc back to the central bins.
+static void
+flush(struct tcache *tc, int c, int n)
+{
+  Header *first, *last;
+
+  first = last = tc->bin[c];
+  for(int i = 1; i < n; i++)
+    last = last->s.ptr;
+  tc->bin[c] = last->s.ptr;
+  tc->count[c] -= n;
+
+  lock(&central.lock);
+  last->s.ptr = central.bin[c];
+  central.bin[c] = first;
+  unlock(&central.lock);
+}
+
+// K&R free, large_lock held.
+static void
+large_free(Header *bp)
+{
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -56,17 +189,18 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  large_free(hp);
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+static void*
+large_malloc(uint nbytes)
 {
   Header *p, *prevp;
   uint nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  lock(&large_lock);
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -80,11 +214,64 @@ malloc(uint nbytes)
         p += p->s.size;
         p->s.size = nunits;
       }
+      p->s.cls = LARGE;
       freep = prevp;
+      unlock(&large_lock);
       return (void*)(p + 1);
     }
     if(p == freep)
-      if((p = morecore(nunits)) == 0)
+      if((p = morecore(nunits)) == 0){
+        unlock(&large_lock);
         return 0;
+      }
+  }
+}
+
+void
+free(void *ap)
+{
+  Header *bp;
+  struct tcache *tc;
+  int c;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  if((c = bp->s.cls) == LARGE){
+    lock(&large_lock);
+    large_free(bp);
+    unlock(&large_lock);
+    return;
+  }
+
+  tc = mycache();
+  lock(&tc->lock);
+  bp->s.ptr = tc->bin[c];
+  tc->bin[c] = bp;
+  if(++tc->count[c] >= 2 * batch(c))
+    flush(tc, c, batch(c));
+  unlock(&tc->lock);
+}
+
+void*
+malloc(uint nbytes)
+{
+  struct tcache *tc;
+  Header *h;
+  int c;
+
+  if(nbytes > MAXSMALL)
+    return large_malloc(nbytes);
+
+  c = size_class(nbytes);
+  tc = mycache();
+  lock(&tc->lock);
+  if(tc->bin[c] == 0)
+    refill(tc, c, batch(c));
+  if((h = tc->bin[c]) != 0){
+    tc->bin[c] = h->s.ptr;
+    tc->count[c]--;
   }
+  unlock(&tc->lock);
+  return h ? (void*)(h + 1) : 0;
 }
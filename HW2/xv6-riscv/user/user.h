@@ -1,4 +1,6 @@
 struct stat;
+struct pollfd;
+struct thread_stats;
 
 // system calls
 int fork(void);
@@ -20,6 +22,7 @@ int chdir(const char*);
 int dup(int);
 int getpid(void);
 char* sbrk(int);
+char* sbrkeager(int);
 int sleep(int);
 int uptime(void);
 int kthread_create(void *(*start_func)(), uint , uint);
@@ -27,6 +30,13 @@ int kthread_id(void);
 int kthread_kill(int);
 void kthread_exit(int);
 int kthread_join(int, uint);
+int sigalarm(int ticks, void (*handler)());
+int sigreturn(void *frame);
+int fcntl(int fd, int cmd, int arg);
+int poll(struct pollfd *fds, int nfds, int timeout);
+int getncpu(void);
+int kthread_stats(int pid, struct thread_stats *st);
+int gangsched(int on);
 
 // ulib.c
 int stat(const char*, struct stat*);
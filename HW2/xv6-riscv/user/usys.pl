@@ -40,4 +40,12 @@ entry("kthread_create");
 entry("kthread_id");
 entry("kthread_kill");
 entry("kthread_exit");
-entry("kthread_join");
\ No newline at end of file
+entry("kthread_join");
+entry("sigalarm");
+entry("sigreturn");
+entry("fcntl");
+entry("poll");
+entry("getncpu");
+entry("kthread_stats");
+entry("gangsched");
+entry("sbrkeager");
\ No newline at end of file
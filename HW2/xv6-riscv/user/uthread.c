@@ -1,81 +1,410 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/fcntl.h"
 #include "user/user.h"
 #include "user/uthread.h"
 
 // task1.1
 struct uthread* currThread;
-struct uthread allProcessThreads[MAX_UTHREADS];
 int systemThreads = 0;
 
-enum sched_priority priority_helper; // used to find max priority
+// One FIFO ready queue per priority, linked through uthread->next.
+// Bit i of ready_mask is set iff ready_head[i] is not empty, so the
+// next thread to run is found without scanning any thread.
+static struct uthread* ready_head[NPRIORITY];
+static struct uthread* ready_tail[NPRIORITY];
+static uint ready_mask;
 
-int uthread_create(void (*start_func)(), enum sched_priority priority)
+// highest priority present in a ready_mask value
+static const char highest_priority[1 << NPRIORITY] = {
+	-1, LOW, MEDIUM, MEDIUM, HIGH, HIGH, HIGH, HIGH
+};
+
+// Exited threads are recycled instead of being handed back to malloc:
+// descriptors go to free_threads, stacks go to free_stacks[class]
+// (linked through their first word). A thread can't release the stack
+// it is running on, so uthread_exit() parks itself in dead_thread and
+// the next thread to run reaps it.
+static struct uthread* free_threads;
+static char* free_stacks[NSTACKCLASS];
+static struct uthread* dead_thread;
+
+static struct context sched_context; // uthread_start_all() switches from here
+
+// Time slicing. A thread of priority p is preempted once it has run
+// for quantum[p] timer ticks without yielding; 0 means it runs until
+// it yields. Ticks arrive as sigalarm() upcalls on the running
+// thread's stack. preempt_off is set while the queues or currThread
+// are being changed, and an upcall that finds it set returns at once.
+static int quantum[NPRIORITY];
+static int slice_ticks;
+static volatile int preempt_off;
+static int started;
+
+// Library code outside the scheduler, such as malloc(), holds off
+// preemption while it holds a spinlock, so that a thread preempted
+// with the lock held can't leave the next thread to spin on it.
+// Counted, since those locks nest, and kept apart from preempt_off,
+// which the scheduler sets and clears outright. Only the kthread
+// that runs the uthreads gets ticks, so the others leave it alone.
+static volatile int lib_off;
+static uint64 sched_tp;
+
+// Event loop. Threads waiting for I/O in uthread_wait_fd() are parked
+// here instead of sleeping in the kernel, and whenever the scheduler
+// picks a thread it polls their fds and requeues the ready ones. The
+// kthread only sleeps in poll() when no thread is runnable.
+static struct uthread* parked;
+static int nparked;
+static struct pollfd* pfds;
+static int pfds_size;
+
+// Threads in uthread_sleep(), in a binary min-heap on wake_time. The
+// heap is checked against the time CSR whenever a thread is picked,
+// so waking sleepers costs no system call.
+#define TICK_TIME  1000000     // time CSR counts per timer tick, as in kernel/start.c
+static struct uthread** sleepers;
+static int nsleeping;
+static int sleepers_size;
+
+static inline uint64
+now(void)
 {
-	// find free thread in the array
-	struct uthread* th;
+	uint64 x;
+	asm volatile("rdtime %0" : "=r" (x));
+	return x;
+}
+
+static void
+enqueue(struct uthread* t)
+{
+	t->next = 0;
+	if(ready_head[t->priority] == 0)
+		ready_head[t->priority] = t;
+	else
+		ready_tail[t->priority]->next = t;
+	ready_tail[t->priority] = t;
+	ready_mask |= 1 << t->priority;
+}
+
+// remove and return the first thread of the highest non-empty queue,
+// or 0 if no thread is runnable.
+static struct uthread*
+dequeue(void)
+{
+	struct uthread* t;
+	int p;
+
+	if(ready_mask == 0)
+		return 0;
+	p = highest_priority[ready_mask];
+	t = ready_head[p];
+	ready_head[p] = t->next;
+	if(ready_head[p] == 0)
+		ready_mask &= ~(1 << p);
+	t->next = 0;
+	return t;
+}
+
+// pool class holding stacks of at least size bytes, -1 if too big to pool.
+static int
+stack_class(uint size)
+{
+	uint s = MIN_STACK_SIZE;
+	for(int c = 0; c < NSTACKCLASS; c++, s <<= 1)
+		if(size <= s)
+			return c;
+	return -1;
+}
+
+static int
+stack_alloc(struct uthread* t, uint size)
+{
+	int c = stack_class(size);
+
+	if(c >= 0){
+		size = MIN_STACK_SIZE << c;
+		if(free_stacks[c]){
+			t->ustack = free_stacks[c];
+			free_stacks[c] = *(char**)t->ustack;
+		} else if((t->ustack = malloc(size)) == 0)
+			return -1;
+	} else if((t->ustack = malloc(size)) == 0)
+		return -1;
+
+	t->stack_size = size;
+	t->stack_class = c;
+	return 0;
+}
+
+static void
+stack_free(struct uthread* t)
+{
+	if(t->stack_class >= 0){
+		*(char**)t->ustack = free_stacks[t->stack_class];
+		free_stacks[t->stack_class] = t->ustack;
+	} else
+		free(t->ustack);
+	t->ustack = 0;
+}
+
+static void
+reap(void)
+{
+	if(dead_thread){
+		stack_free(dead_thread);
+		dead_thread->next = free_threads;
+		free_threads = dead_thread;
+		dead_thread = 0;
+	}
+}
+
+// Poll the fds of all parked threads and queue those that are ready,
+// waiting at most timeout ticks (-1: until one is ready).
+static void
+poll_parked(int timeout)
+{
+	struct uthread* t;
+	struct uthread** pp;
 	int i;
-	for( i=0 ;i< MAX_UTHREADS && allProcessThreads[i].state != FREE; i++);
-	
-	if(allProcessThreads[i].state != FREE)
+
+	if(nparked > pfds_size){
+		free(pfds);
+		pfds_size = nparked * 2;
+		if((pfds = malloc(pfds_size * sizeof(*pfds))) == 0){
+			pfds_size = 0;
+			return;
+		}
+	}
+	for(t = parked, i = 0; t; t = t->next, i++){
+		pfds[i].fd = t->wait_fd;
+		pfds[i].events = t->wait_events;
+		pfds[i].revents = 0;
+	}
+	if(poll(pfds, nparked, timeout) <= 0)
+		return;
+
+	for(pp = &parked, i = 0; (t = *pp) != 0; i++){
+		if(pfds[i].revents){
+			*pp = t->next;
+			nparked--;
+			t->wait_events = pfds[i].revents;
+			t->state = RUNNABLE;
+			enqueue(t);
+		} else
+			pp = &t->next;
+	}
+}
+
+static void
+sleepers_push(struct uthread* t)
+{
+	int i, parent;
+
+	for(i = nsleeping++; i > 0; i = parent){
+		parent = (i - 1) / 2;
+		if(sleepers[parent]->wake_time <= t->wake_time)
+			break;
+		sleepers[i] = sleepers[parent];
+	}
+	sleepers[i] = t;
+}
+
+static struct uthread*
+sleepers_pop(void)
+{
+	struct uthread* top = sleepers[0];
+	struct uthread* last = sleepers[--nsleeping];
+	int i = 0, child;
+
+	while((child = 2 * i + 1) < nsleeping){
+		if(child + 1 < nsleeping && sleepers[child + 1]->wake_time < sleepers[child]->wake_time)
+			child++;
+		if(last->wake_time <= sleepers[child]->wake_time)
+			break;
+		sleepers[i] = sleepers[child];
+		i = child;
+	}
+	sleepers[i] = last;
+	return top;
+}
+
+// queue the sleepers whose time has come.
+static void
+wake_sleepers(void)
+{
+	uint64 t;
+	struct uthread* th;
+
+	if(nsleeping == 0)
+		return;
+	t = now();
+	while(nsleeping > 0 && sleepers[0]->wake_time <= t){
+		th = sleepers_pop();
+		th->state = RUNNABLE;
+		enqueue(th);
+	}
+}
+
+// ticks until the first sleeper is due, -1 if none is sleeping.
+static int
+next_timeout(void)
+{
+	uint64 t;
+
+	if(nsleeping == 0)
+		return -1;
+	t = now();
+	if(sleepers[0]->wake_time <= t)
+		return 0;
+	return (sleepers[0]->wake_time - t + TICK_TIME - 1) / TICK_TIME;
+}
+
+// dequeue() the next thread to run, first requeueing sleepers that are
+// due and parked threads whose fds are ready. When no thread is ready
+// the kthread sleeps in poll() or sleep() until one of them is.
+// Returns 0 only if there are no threads left.
+static struct uthread*
+pick_next(void)
+{
+	int timeout;
+
+	for(;;){
+		wake_sleepers();
+		if(ready_mask == 0 && nparked == 0 && nsleeping == 0){
+			if(systemThreads > 0){
+				// the rest wait on channels nobody will touch.
+				printf("uthread: deadlock, all threads blocked\n");
+				exit(1);
+			}
+			return 0;
+		}
+		timeout = ready_mask ? 0 : next_timeout();
+		if(nparked > 0)
+			poll_parked(timeout);
+		else if(timeout > 0)
+			sleep(timeout);
+		if(ready_mask)
+			return dequeue();
+	}
+}
+
+// Switch from t, which has already been queued or parked, to the
+// next thread to run. Called with preempt_off set.
+static void
+switch_from(struct uthread* t)
+{
+	struct uthread* nextT = pick_next();
+
+	currThread = nextT;
+	currThread->state = RUNNING;
+	slice_ticks = 0;
+	if(nextT != t){
+		uswtch(&t->context, &nextT->context); // function in uthread.h
+		reap();
+		slice_ticks = 0;
+	}
+}
+
+// sigalarm() handler, runs on the stack of the interrupted thread.
+static void
+uthread_tick(void* frame)
+{
+	int q = quantum[currThread->priority];
+
+	if(!preempt_off && !lib_off && q > 0 && ++slice_ticks >= q)
+		uthread_yield();
+	sigreturn(frame);
+}
+
+static void
+preempt_start(void)
+{
+	for(int p = 0; p < NPRIORITY; p++)
+		if(quantum[p] > 0){
+			sigalarm(1, uthread_tick);
+			return;
+		}
+	sigalarm(0, 0);
+}
+
+// first code run by every new thread, on its own stack.
+static void
+uthread_entry(void)
+{
+	reap();
+	slice_ticks = 0;
+	preempt_off = 0;
+	currThread->start_func();
+	uthread_exit();
+}
+
+int uthread_create_stack(void (*start_func)(), enum sched_priority priority, uint stack_size)
+{
+	struct uthread* th;
+
+	preempt_off = 1;
+	if(free_threads){
+		th = free_threads;
+		free_threads = th->next;
+	} else if((th = malloc(sizeof(*th))) == 0){
+		preempt_off = 0;
 		return -1; //failure
+	}
+
+	if(stack_alloc(th, stack_size) < 0){
+		th->next = free_threads;
+		free_threads = th;
+		preempt_off = 0;
+		return -1; //failure
+	}
 
-	th = &allProcessThreads[i];
 	// Set up new context to start executing, same as in allocproc function in proc.c
   	// which returns to user space.
 	memset(&th->context, 0, sizeof(th->context));
 	th->priority = priority;
 	th->state = RUNNABLE;
-	th->context.ra = (uint64)start_func;
-	th->context.sp = (uint64)&(th->ustack) + STACK_SIZE;
+	th->start_func = start_func;
+	th->context.ra = (uint64)uthread_entry;
+	th->context.sp = ((uint64)th->ustack + th->stack_size) & ~0xfL;
+	enqueue(th);
 	systemThreads += 1;
+	preempt_off = 0;
 	return 0; //success
 }
 
+int uthread_create(void (*start_func)(), enum sched_priority priority)
+{
+	return uthread_create_stack(start_func, priority, STACK_SIZE);
+}
+
 
 void uthread_yield()
 {
 	// same as yield function in proc.c
-	currThread->state = RUNNABLE;
-	
-	struct uthread* t;
-	struct uthread* nextT = allProcessThreads;
-	priority_helper = LOW;
-	for( t = allProcessThreads; t < &allProcessThreads[MAX_UTHREADS]; t++)
-	{
-		if(t->state == RUNNABLE &&  priority_helper <= t->priority)
-		{
-			priority_helper = t->priority;
-			nextT = t;
-		}
-	}
-	t = currThread;
-	currThread = nextT;
-	currThread->state = RUNNING;
-	uswtch(&t->context, &nextT->context); // function in uthread.h
+	struct uthread* t = currThread;
+
+	preempt_off = 1;
+	t->state = RUNNABLE;
+	enqueue(t);
+	switch_from(t);
+	preempt_off = 0;
 }
 
 void uthread_exit()
 {
-	currThread->state = FREE;
-	currThread->priority = 0;
+	struct uthread* t = currThread;
+
+	preempt_off = 1;
+	t->state = FREE;
+	t->priority = LOW;
 	systemThreads -= 1;
 	if(systemThreads <= 0)
 		exit(0);
 
-	struct uthread* t;
-	struct uthread* nextT = allProcessThreads;
-	priority_helper = LOW;
-	for( t = allProcessThreads; t < &allProcessThreads[MAX_UTHREADS]; t++)
-	{
-		if(t->state == RUNNABLE && priority_helper <= t->priority)
-		{
-			priority_helper = t->priority;
-			nextT = t;
-		}
-	}
-	t = currThread;
-	currThread = nextT;
+	reap();
+	dead_thread = t;
+	currThread = pick_next();
 	currThread->state = RUNNING;
 	uswtch(&t->context, &currThread->context); // function in uthread.h
 }
@@ -88,32 +417,22 @@ int uthread_start_all()
 	if (first) {
 
 		first = 0;
-		
-		struct uthread* t;
-		struct uthread* nextT = allProcessThreads;
-		priority_helper = LOW;
-		for( t = allProcessThreads; t < &allProcessThreads[MAX_UTHREADS]; t++)
-		{
-			if(t->state == RUNNABLE &&  priority_helper <= t->priority)
-			{
-				priority_helper = t->priority;
-				nextT = t;
-			}
-		} 
-		t = currThread;
-		currThread = nextT;
+
+		if((currThread = pick_next()) == 0)
+			return -1;
 		currThread->state = RUNNING;
-		
-		//uswtch(&context, &nextT->context); // function in uthread.h
-		
-		((void (*)())(currThread->context.ra))();
+		preempt_off = 1;
+		asm volatile("mv %0, tp" : "=r" (sched_tp));
+		started = 1;
+		preempt_start();
+		uswtch(&sched_context, &currThread->context); // function in uthread.h
 		exit(0);
   	}
 	else
 	{
 		return -1;
 	}
-  	
+
 }
 
 enum sched_priority uthread_set_priority(enum sched_priority priority)
@@ -134,4 +453,289 @@ struct uthread* uthread_self()
 	return currThread;
 }
 
+// Set the time slice of priority to ticks timer ticks, 0 for
+// cooperative scheduling. Returns the previous value.
+int uthread_set_quantum(enum sched_priority priority, int ticks)
+{
+	int old;
+
+	if(priority < LOW || priority > HIGH || ticks < 0)
+		return -1;
+	old = quantum[priority];
+	quantum[priority] = ticks;
+	if(started)
+		preempt_start();
+	return old;
+}
+
+static int
+on_sched_kthread(void)
+{
+	uint64 tp;
+
+	asm volatile("mv %0, tp" : "=r" (tp));
+	return started && tp == sched_tp;
+}
+
+void uthread_preempt_disable(void)
+{
+	if(on_sched_kthread())
+		lib_off++;
+}
+
+void uthread_preempt_enable(void)
+{
+	if(on_sched_kthread())
+		lib_off--;
+}
+
+// Park the calling thread until one of the poll() events is ready on
+// fd, letting the other threads run meanwhile. Returns the events.
+int uthread_wait_fd(int fd, int events)
+{
+	struct uthread* t = currThread;
+
+	preempt_off = 1;
+	t->state = BLOCKED;
+	t->wait_fd = fd;
+	t->wait_events = events;
+	t->next = parked;
+	parked = t;
+	nparked++;
+	switch_from(t);
+	preempt_off = 0;
+	return t->wait_events;
+}
+
+// read() and write() that park only the calling thread while an
+// O_NONBLOCK fd is not ready. On a blocking fd they block the process.
+int uthread_read(int fd, void* buf, int n)
+{
+	int r;
+
+	while((r = read(fd, buf, n)) == -EAGAIN)
+		uthread_wait_fd(fd, POLLIN);
+	return r;
+}
+
+int uthread_write(int fd, const void* buf, int n)
+{
+	int r, done = 0;
+
+	while(done < n){
+		if((r = write(fd, (char*)buf + done, n - done)) == -EAGAIN){
+			uthread_wait_fd(fd, POLLOUT);
+			continue;
+		}
+		if(r < 0)
+			return done > 0 ? done : r;
+		done += r;
+	}
+	return done;
+}
+
+// Block the calling thread for ticks timer ticks while the others run.
+void uthread_sleep(int ticks)
+{
+	struct uthread* t = currThread;
+	struct uthread** bigger;
+
+	if(ticks <= 0){
+		uthread_yield();
+		return;
+	}
+	if(nsleeping == sleepers_size){
+		if((bigger = malloc((sleepers_size * 2 + 8) * sizeof(*bigger))) == 0){
+			sleep(ticks);
+			return;
+		}
+		if(sleepers){
+			memmove(bigger, sleepers, nsleeping * sizeof(*bigger));
+			free(sleepers);
+		}
+		sleepers = bigger;
+		sleepers_size = sleepers_size * 2 + 8;
+	}
+
+	preempt_off = 1;
+	t->state = BLOCKED;
+	t->wake_time = now() + (uint64)ticks * TICK_TIME;
+	sleepers_push(t);
+	switch_from(t);
+	preempt_off = 0;
+}
+
+// Channels. The ring is Vyukov's bounded MPMC queue: cell i is free for
+// the send at position p when its seq is p, and holds that message for
+// the receive at p when its seq is p + 1. Parking and waking are done
+// with preempt_off set; since the other threads of the channel run on
+// this kthread, a thread that re-checks the ring with preemption off
+// and parks cannot miss the wakeup.
+
+struct channel* chan_create(int capacity)
+{
+	struct channel* c;
+	uint cap = 1;
+
+	if(capacity <= 0)
+		return 0;
+	while(cap < capacity)
+		cap <<= 1;
+	if((c = malloc(sizeof(*c))) == 0)
+		return 0;
+	memset(c, 0, sizeof(*c));
+	if((c->cells = malloc(cap * sizeof(struct chan_cell))) == 0){
+		free(c);
+		return 0;
+	}
+	for(uint i = 0; i < cap; i++)
+		c->cells[i].seq = i;
+	c->mask = cap - 1;
+	return c;
+}
+
+// The channel must be closed and no thread may still use it.
+void chan_destroy(struct channel* c)
+{
+	free(c->cells);
+	free(c);
+}
+
+static int
+chan_trysend(struct channel* c, void* val)
+{
+	uint pos = __atomic_load_n(&c->head, __ATOMIC_RELAXED);
+	struct chan_cell* cell;
+	int d;
+
+	for(;;){
+		cell = &c->cells[pos & c->mask];
+		d = (int)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+		if(d == 0){
+			if(__atomic_compare_exchange_n(&c->head, &pos, pos + 1, 1,
+			                               __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if(d < 0)
+			return -1; // full
+		else
+			pos = __atomic_load_n(&c->head, __ATOMIC_RELAXED);
+	}
+	cell->val = val;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int
+chan_tryrecv(struct channel* c, void** val)
+{
+	uint pos = __atomic_load_n(&c->tail, __ATOMIC_RELAXED);
+	struct chan_cell* cell;
+	int d;
+
+	for(;;){
+		cell = &c->cells[pos & c->mask];
+		d = (int)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+		if(d == 0){
+			if(__atomic_compare_exchange_n(&c->tail, &pos, pos + 1, 1,
+			                               __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if(d < 0)
+			return -1; // empty
+		else
+			pos = __atomic_load_n(&c->tail, __ATOMIC_RELAXED);
+	}
+	*val = cell->val;
+	__atomic_store_n(&cell->seq, pos + c->mask + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+// park the calling thread on a waiter list. Called with preempt_off set.
+static void
+chan_park(struct uthread** head, struct uthread** tail)
+{
+	struct uthread* t = currThread;
+
+	t->state = BLOCKED;
+	t->next = 0;
+	if(*head == 0)
+		*head = t;
+	else
+		(*tail)->next = t;
+	*tail = t;
+	switch_from(t);
+}
+
+// make the first thread on a waiter list runnable again.
+static void
+chan_wake(struct uthread** head)
+{
+	struct uthread* t;
 
+	if(*head == 0)
+		return;
+	preempt_off = 1;
+	if((t = *head) != 0){
+		*head = t->next;
+		t->state = RUNNABLE;
+		enqueue(t);
+	}
+	preempt_off = 0;
+}
+
+// Send val, waiting while the channel is full.
+// Returns -1 if the channel is closed.
+int chan_send(struct channel* c, void* val)
+{
+	int sent;
+
+	for(;;){
+		if(c->closed)
+			return -1;
+		if(chan_trysend(c, val) == 0)
+			break;
+		preempt_off = 1;
+		sent = !c->closed && chan_trysend(c, val) == 0;
+		if(!sent && !c->closed)
+			chan_park(&c->senders, &c->senders_tail);
+		preempt_off = 0;
+		if(sent)
+			break;
+	}
+	chan_wake(&c->receivers);
+	return 0;
+}
+
+// Receive into *val, waiting while the channel is empty. Returns -1
+// once the channel is closed and all sent values have been received.
+int chan_recv(struct channel* c, void** val)
+{
+	for(;;){
+		if(chan_tryrecv(c, val) == 0){
+			chan_wake(&c->senders);
+			return 0;
+		}
+		preempt_off = 1;
+		if(chan_tryrecv(c, val) == 0){
+			preempt_off = 0;
+			chan_wake(&c->senders);
+			return 0;
+		}
+		if(c->closed){
+			preempt_off = 0;
+			return -1;
+		}
+		chan_park(&c->receivers, &c->receivers_tail);
+		preempt_off = 0;
+	}
+}
+
+// Fail all further sends and wake every waiting thread; receivers
+// still get the values already sent.
+void chan_close(struct channel* c)
+{
+	c->closed = 1;
+	while(c->senders || c->receivers){
+		chan_wake(&c->senders);
+		chan_wake(&c->receivers);
+	}
+}
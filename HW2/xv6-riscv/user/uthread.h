@@ -1,10 +1,12 @@
-#define STACK_SIZE  4000
-#define MAX_UTHREADS  4
+#define STACK_SIZE  4000       // default stack size of uthread_create()
+#define MIN_STACK_SIZE  1024   // smallest pooled stack
+#define NSTACKCLASS  8         // pooled stack classes: 1KB, 2KB, ... 128KB
 
 enum sched_priority { LOW, MEDIUM, HIGH };
+#define NPRIORITY  3
 
 /* Possible states of a thread: */
-enum tstate { FREE, RUNNING, RUNNABLE };
+enum tstate { FREE, RUNNING, RUNNABLE, BLOCKED };
 
 // Saved registers for context switches.
 struct context {
@@ -27,15 +29,44 @@ struct context {
 };
 
 struct uthread {
-    char                ustack[STACK_SIZE];  // the thread's stack
-    enum tstate         state;          // FREE, RUNNING, RUNNABLE
+    char                *ustack;        // the thread's stack, taken from the stack pool
+    uint                stack_size;     // usable size of ustack
+    int                 stack_class;    // pool class of ustack, -1 if not pooled
+    enum tstate         state;          // FREE, RUNNING, RUNNABLE, BLOCKED
     struct context      context;        // uswtch() here to run process
     enum sched_priority priority;       // scheduling priority
+    void                (*start_func)();// entry point, called by uthread_entry()
+    struct uthread      *next;          // ready queue / parked / free list link
+    int                 wait_fd;        // BLOCKED in uthread_wait_fd() on this fd
+    int                 wait_events;    // poll() events waited for, then received
+    uint64              wake_time;      // BLOCKED in uthread_sleep() until this time
+};
+
+// Bounded multi-producer multi-consumer channel of pointers between
+// the uthreads of a process. Sends and receives go through a lock-free
+// ring; a uthread that finds it full (or empty) is parked on the
+// channel until a receiver (or sender) makes room.
+struct chan_cell {
+    volatile uint       seq;            // ring position this cell is ready for
+    void                *val;
+};
+
+struct channel {
+    uint                mask;           // capacity - 1, capacity a power of two
+    struct chan_cell    *cells;
+    uint                head;           // next position to send to
+    uint                tail;           // next position to receive from
+    int                 closed;
+    struct uthread      *senders;       // parked on a full channel, FIFO
+    struct uthread      *senders_tail;
+    struct uthread      *receivers;     // parked on an empty channel, FIFO
+    struct uthread      *receivers_tail;
 };
 
 extern void uswtch(struct context*, struct context*);
 
 int uthread_create(void (*start_func)(), enum sched_priority priority);
+int uthread_create_stack(void (*start_func)(), enum sched_priority priority, uint stack_size);
 
 void uthread_yield();
 void uthread_exit();
@@ -45,3 +76,19 @@ enum sched_priority uthread_set_priority(enum sched_priority priority);
 enum sched_priority uthread_get_priority();
 
 struct uthread* uthread_self();
+
+int uthread_set_quantum(enum sched_priority priority, int ticks);
+void uthread_preempt_disable(void);
+void uthread_preempt_enable(void);
+
+int uthread_wait_fd(int fd, int events);
+int uthread_read(int fd, void *buf, int n);
+int uthread_write(int fd, const void *buf, int n);
+
+void uthread_sleep(int ticks);
+
+struct channel* chan_create(int capacity);
+void chan_destroy(struct channel *c);
+int chan_send(struct channel *c, void *val);
+int chan_recv(struct channel *c, void **val);
+void chan_close(struct channel *c);
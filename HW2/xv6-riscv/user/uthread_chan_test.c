@@ -0,0 +1,106 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+// A pipeline of uthreads joined by channels: the source sends 1..NMSG,
+// every stage adds one, and the sink checks what comes out and prints
+// the time per message. Channels smaller than the stream make every
+// stage park and wake many times. Then three sleepers must wake in the
+// order of their deadlines, not of their uthread_sleep() calls.
+
+#define NSTAGE   4
+#define NMSG     10000
+#define CAPACITY 8
+
+struct channel *chans[NSTAGE + 1];
+uint64 t0;
+
+static inline uint64
+now(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+void source(void){
+  t0 = now();
+  for(uint64 i = 1; i <= NMSG; i++)
+    chan_send(chans[0], (void*)i);
+  chan_close(chans[0]);
+  uthread_exit();
+}
+
+void stage(void){
+  static int next_id;
+  int id = next_id++;
+  void *v;
+
+  while(chan_recv(chans[id], &v) == 0)
+    chan_send(chans[id + 1], (void*)((uint64)v + 1));
+  chan_close(chans[id + 1]);
+  uthread_exit();
+}
+
+int wake_order[3];
+int nwoken;
+
+void sleeper(void){
+  static int next_id;
+  int id = next_id++;
+
+  // ids 0, 1, 2 sleep 3, 1, 2 ticks.
+  uthread_sleep(id == 0 ? 3 : id);
+  wake_order[nwoken++] = id;
+  uthread_exit();
+}
+
+void sink(void){
+  void *v;
+  uint64 n = 0;
+
+  while(chan_recv(chans[NSTAGE], &v) == 0){
+    n++;
+    if((uint64)v != n + NSTAGE){
+      printf("uthread_chan_test: got %l, expected %l\n", (uint64)v, n + NSTAGE);
+      exit(1);
+    }
+  }
+  if(n != NMSG){
+    printf("uthread_chan_test: got %l messages, expected %d\n", n, NMSG);
+    exit(1);
+  }
+  // qemu virt's time CSR runs at 10MHz.
+  printf("uthread_chan_test: %d stages, %l ns per message\n",
+         NSTAGE, (now() - t0) * 100 / NMSG);
+
+  for(int i = 0; i < 3; i++)
+    uthread_create(sleeper, LOW);
+  while(nwoken < 3)
+    uthread_yield();
+  if(wake_order[0] != 1 || wake_order[1] != 2 || wake_order[2] != 0){
+    printf("uthread_chan_test: sleepers woke in order %d %d %d\n",
+           wake_order[0], wake_order[1], wake_order[2]);
+    exit(1);
+  }
+  printf("uthread_chan_test: OK\n");
+  uthread_exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  for(int i = 0; i <= NSTAGE; i++){
+    if((chans[i] = chan_create(CAPACITY)) == 0){
+      printf("uthread_chan_test: chan_create failed\n");
+      exit(1);
+    }
+  }
+  uthread_create(source, LOW);
+  for(int i = 0; i < NSTAGE; i++)
+    uthread_create(stage, LOW);
+  uthread_create(sink, LOW);
+  uthread_start_all();
+  exit(0);
+}
@@ -0,0 +1,85 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+// Readers park on empty non-blocking pipes while a worker thread keeps
+// running; the writer then fills the pipes in reverse order, and every
+// reader must get its own message.
+
+#define NREADERS 3
+
+int fds[NREADERS][2];
+volatile int nread_done;
+volatile int worker_ran;
+
+void reader(void){
+  static int next_id;
+  int id = next_id++;
+  char c;
+
+  if(uthread_read(fds[id][0], &c, 1) != 1 || c != 'a' + id){
+    printf("uthread_io_test: reader %d got a bad byte\n", id);
+    exit(1);
+  }
+  nread_done++;
+  uthread_exit();
+}
+
+void worker(void){
+  // must run while all readers are parked.
+  for(int i = 0; i < 10; i++){
+    worker_ran++;
+    uthread_yield();
+  }
+  uthread_exit();
+}
+
+void writer(void){
+  char c;
+
+  while(worker_ran < 10)
+    uthread_yield();
+  if(nread_done != 0){
+    printf("uthread_io_test: reader returned before any write\n");
+    exit(1);
+  }
+  for(int i = NREADERS - 1; i >= 0; i--){
+    c = 'a' + i;
+    if(uthread_write(fds[i][1], &c, 1) != 1){
+      printf("uthread_io_test: write failed\n");
+      exit(1);
+    }
+  }
+  while(nread_done < NREADERS)
+    uthread_yield();
+  printf("uthread_io_test: OK\n");
+  uthread_exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  char c;
+
+  for(int i = 0; i < NREADERS; i++){
+    if(pipe(fds[i]) < 0){
+      printf("uthread_io_test: pipe failed\n");
+      exit(1);
+    }
+    fcntl(fds[i][0], F_SETFL, O_NONBLOCK);
+  }
+  if(read(fds[0][0], &c, 1) != -EAGAIN){
+    printf("uthread_io_test: O_NONBLOCK read did not return -EAGAIN\n");
+    exit(1);
+  }
+
+  for(int i = 0; i < NREADERS; i++)
+    uthread_create(reader, HIGH);
+  uthread_create(worker, MEDIUM);
+  uthread_create(writer, LOW);
+  uthread_start_all();
+  printf("uthread_start_all failed\n");
+  exit(1);
+}
@@ -0,0 +1,44 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+// A LOW thread spins without ever yielding. With time slicing on,
+// the HIGH thread it starves must still get to run and finish.
+
+volatile int high_done;
+
+void spinner(void){
+  int start = uptime();
+  while(!high_done){
+    if(uptime() - start > 200){
+      printf("uthread_preempt_test: HIGH thread starved\n");
+      exit(1);
+    }
+  }
+  printf("uthread_preempt_test: OK\n");
+  uthread_exit();
+}
+
+void high_func(void){
+  high_done = 1;
+  uthread_exit();
+}
+
+void starter(void){
+  // created after spinner is already running, so only a
+  // preemption can let it run.
+  uthread_create(high_func, HIGH);
+  uthread_set_priority(LOW);
+  spinner();
+}
+
+int
+main(int argc, char *argv[])
+{
+  uthread_set_quantum(LOW, 2);
+  uthread_create(starter, LOW);
+  uthread_start_all();
+  printf("uthread_start_all failed\n");
+  exit(1);
+}
@@ -68,6 +68,9 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            krefinc(void *);
+int             krefcount(void *);
+int             kfreepages(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -90,7 +93,7 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
+int             growproc(int, int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
@@ -111,15 +114,37 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
-int             writeToSwapFile_(struct proc * );
-int             createSwapFile_(struct proc * );
 int             shouldIgnore(struct proc * );
-void            dealWithPageFault(uint64 );
-void            addToMemory(uint64);
-int             swap_algo_page_index(void);
-void            algo_file_swapout(int);
-void            removeMemoryPage(uint64);
-int             unused_page_in_memory_index(struct proc *);
+int             dealWithPageFault(uint64 );
+void            pgfault_count(struct proc*, int, uint64);
+void            addToMemory(pagetable_t, uint64, uint64);
+void            removeMemoryPage(pagetable_t, uint64);
+void            swapslot_free(int);
+void            swap_lock(struct proc *);
+void            swap_unlock(struct proc *);
+void            frames_release(struct proc *);
+void            frames_adopt(struct proc *);
+void*           ualloc(void);
+uint64          pinpage(pagetable_t, uint64);
+void            unpinpage(pagetable_t);
+int             pgstat(int, uint64);
+void            aging_tick(void);
+int             pgpolicy(int, int);
+void            kswapdinit(void);
+
+// lz.c
+int             lz_compress(char *, char *, int);
+int             lz_decompress(char *, int, char *);
+
+// swap.c
+void            swapinit(void);
+int             swap_alloc(void);
+int             swap_alloc_run(int, int *);
+void            swap_free(int);
+int             swap_nfree(void);
+int             swapio(int, char **, int, int);
+void            swap_dup(int);
+int             swap_shared(int);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -182,7 +207,9 @@ pagetable_t     uvmcreate(void);
 void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
-int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopy(pagetable_t, pagetable_t, uint64, int);
+int             uvmcow(pagetable_t, uint64);
+int             uvmlazy(pagetable_t, uint64, uint64, int);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
@@ -202,6 +229,8 @@ void            plic_complete(int);
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
 void            virtio_disk_intr(void);
+void            virtio_disk_rw_pages(uint, char **, int, int);
+uint64          virtio_disk_blocks(void);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -31,11 +31,6 @@ exec(char *path, char **argv)
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
-  struct pageInMemory Bpages_in_memory[MAX_PSYC_PAGES]; // backup
-  struct pageInMemory Bpages_in_swapFile[MAX_PSYC_PAGES]; // backup
-  memmove(Bpages_in_memory, p->pages_in_memory, sizeof(p->pages_in_memory));
-  memmove(Bpages_in_swapFile, p->pages_in_swapFile, sizeof(p->pages_in_swapFile));
-
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -44,11 +39,6 @@ exec(char *path, char **argv)
   }
   ilock(ip);
 
-  if(shouldIgnore(p) && createSwapFile_(p) < 0)
-  {
-    goto bad;
-  }
-
   // Check ELF header
   if(readi(ip, 0, (uint64)&elf, 0, sizeof(elf)) != sizeof(elf))
     goto bad;
@@ -131,9 +121,21 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  if(shouldIgnore(p))
+  {
+    // the old image's pages go with it, and its swap slots
+    // with its page table.
+    swap_lock(p);
+    frames_release(p);
+  }
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
   p->sz = sz;
+  if(shouldIgnore(p))
+  {
+    frames_adopt(p);
+    swap_unlock(p);
+  }
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
@@ -141,8 +143,6 @@ exec(char *path, char **argv)
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
-  memmove(p->pages_in_memory, Bpages_in_memory, sizeof(Bpages_in_memory));
-  memmove(p->pages_in_swapFile, Bpages_in_swapFile,sizeof(Bpages_in_swapFile));
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
@@ -0,0 +1,152 @@
+// A small LZ77 codec for whole pages, in the block format of LZ4:
+// each sequence is a token byte, whose high and low nibbles are the
+// number of literals and the match length less 4 (15 meaning that
+// more bytes follow, 255 meaning more again), then the literals,
+// then the match's offset back, two bytes little-endian. The last
+// sequence has literals only. Matches are found through a table of
+// the last position of each hash of 4 bytes, so compression is one
+// pass over the page.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define MINMATCH  4
+#define LASTLITS  5            // the end of the page is always literals
+#define HASHBITS  10
+
+// positions by hash; callers of lz_compress() take turns.
+static ushort table[1 << HASHBITS];
+
+static uint
+get32(uchar *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint)p[3] << 24;
+}
+
+static uint
+hash(uchar *p)
+{
+  return (get32(p) * 2654435761U) >> (32 - HASHBITS);
+}
+
+// Put a length past 15 as 255s and the rest.
+static uchar*
+putlen(uchar *op, int n)
+{
+  for(; n >= 255; n -= 255)
+    *op++ = 255;
+  *op++ = n;
+  return op;
+}
+
+// Put a sequence of nlit literals at lit, and a match of mlen bytes
+// off bytes back unless mlen is 0. Returns where it ended, or 0 if
+// that would pass oend.
+static uchar*
+putseq(uchar *op, uchar *oend, uchar *lit, int nlit, int off, int mlen)
+{
+  uchar *token = op++;
+
+  // the worst case of the lengths, literals and offset.
+  if(op + nlit + nlit/255 + mlen/255 + 4 > oend)
+    return 0;
+  *token = (nlit < 15 ? nlit : 15) << 4;
+  if(nlit >= 15)
+    op = putlen(op, nlit - 15);
+  memmove(op, lit, nlit);
+  op += nlit;
+  if(mlen == 0)
+    return op;
+  *op++ = off;
+  *op++ = off >> 8;
+  mlen -= MINMATCH;
+  *token |= mlen < 15 ? mlen : 15;
+  if(mlen >= 15)
+    op = putlen(op, mlen - 15);
+  return op;
+}
+
+// Compress the page at src into at most cap bytes at dst. Returns
+// the compressed size, or -1 if it takes more than cap.
+int
+lz_compress(char *src, char *dst, int cap)
+{
+  uchar *base = (uchar*)src, *ip = base, *anchor = base;
+  uchar *end = base + PGSIZE, *limit = end - LASTLITS - MINMATCH;
+  uchar *op = (uchar*)dst, *oend = op + cap;
+  uchar *ref, *m, *r;
+
+  memset(table, 0, sizeof(table));
+  while(ip < limit){
+    uint h = hash(ip);
+    ref = base + table[h];
+    table[h] = ip - base;
+    if(ref >= ip || get32(ref) != get32(ip)){
+      ip++;
+      continue;
+    }
+    for(m = ip + MINMATCH, r = ref + MINMATCH; m < end - LASTLITS && *m == *r; m++, r++)
+      ;
+    if((op = putseq(op, oend, anchor, ip - anchor, ip - ref, m - ip)) == 0)
+      return -1;
+    ip = anchor = m;
+  }
+  if((op = putseq(op, oend, anchor, end - anchor, 0, 0)) == 0)
+    return -1;
+  return op - (uchar*)dst;
+}
+
+// Get a length past 15. Returns -1 past iend.
+static int
+getlen(uchar **ip, uchar *iend)
+{
+  int n = 0, c;
+
+  do {
+    if(*ip >= iend)
+      return -1;
+    c = *(*ip)++;
+    n += c;
+  } while(c == 255);
+  return n;
+}
+
+// Decompress the len bytes at src into the page at dst. Returns -1
+// if they aren't a whole page from lz_compress().
+int
+lz_decompress(char *src, int len, char *dst)
+{
+  uchar *ip = (uchar*)src, *iend = ip + len;
+  uchar *op = (uchar*)dst, *oend = op + PGSIZE;
+  int token, n, off;
+
+  while(ip < iend){
+    token = *ip++;
+    n = token >> 4;
+    if(n == 15 && (n += getlen(&ip, iend)) < 15)
+      return -1;
+    if(ip + n > iend || op + n > oend)
+      return -1;
+    memmove(op, ip, n);
+    ip += n;
+    op += n;
+    if(ip == iend)
+      break;
+    if(ip + 2 > iend)
+      return -1;
+    off = ip[0] | ip[1] << 8;
+    ip += 2;
+    n = token & 15;
+    if(n == 15 && (n += getlen(&ip, iend)) < 15)
+      return -1;
+    n += MINMATCH;
+    if(off == 0 || op - off < (uchar*)dst || op + n > oend)
+      return -1;
+    // byte by byte, since the match may overlap what it makes.
+    for(; n > 0; n--, op++)
+      *op = *(op - off);
+  }
+  return op == oend ? 0 : -1;
+}
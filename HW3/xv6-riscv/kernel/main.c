@@ -29,6 +29,7 @@ main()
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
+    kswapdinit();    // page reclaim process
     __sync_synchronize();
     started = 1;
   } else {
@@ -11,3 +11,13 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define NSWAPPAGE    1024  // most pages of the swap area after the file system
+#define NUSERFRAME   96    // resident pages of all processes that swap
+#define KRESERVE     64    // free pages below which user pages are swapped out
+#define KSWAPD_LOW   8     // free frames below which kswapd is woken
+#define KSWAPD_HIGH  24    // free frames kswapd stops at
+#define KSWAPD_BATCH 8     // pages kswapd swaps out between yields
+#define RA_MAX       16    // most pages read ahead on a swap-in fault
+#define SWAP_CLUSTER 8     // most pages swapped out in one write
+#define AGE_TICKS    1     // ticks between scans of A bits for NFUA and LAPA
+#define ZPOOL_PAGES  64    // pages of memory holding compressed swapped out pages
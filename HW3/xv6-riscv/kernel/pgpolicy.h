@@ -0,0 +1,12 @@
+// Page replacement policies, for pgpolicy(), which returns -1 only
+// on error, so none of them is negative.
+#define PGP_SCFIFO     0   // second chance FIFO
+#define PGP_NFUA       1   // not frequently used, with aging
+#define PGP_LAPA       2   // least accessed page, with aging
+#define PGP_CLOCKPRO   3   // CLOCK-Pro
+#define PGP_ARC        4   // ARC, as CAR
+#define NPGPOLICY      5
+#define PGP_DEFAULT    NPGPOLICY       // a process's: follow the system-wide one
+#define PGP_GET        (NPGPOLICY + 1) // only return the policy
+
+#define PGP_NAMES { "scfifo", "nfua", "lapa", "clockpro", "arc" }
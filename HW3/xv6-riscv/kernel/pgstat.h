@@ -0,0 +1,30 @@
+// Paging counters, of one process or of the whole system.
+struct pgstat {
+  uint64 minor;           // page faults fixed with no swap I/O
+  uint64 major;           // page faults that swapped a page in
+  uint64 swapins;         // pages read back from swap
+  uint64 swapouts;        // pages swapped out
+  uint64 clean;           // of those, clean ones dropped with no write
+  uint64 ra_pages;        // pages read ahead of a fault
+  uint64 ra_hits;         // of those, used before they went
+  uint64 ra_misses;       // and not used
+  uint64 swap_rbytes;     // bytes read from swap
+  uint64 swap_wbytes;     // bytes written to swap
+  uint64 fault_ns;        // time spent in page faults
+  int policy;             // replacement policy in effect, PGP_*
+
+  // of the whole system only.
+  uint64 kswapd_wakeups;  // times kswapd was woken
+  uint64 kswapd_pages;    // pages kswapd swapped out
+  uint64 direct_pages;    // pages swapped out by allocating processes
+  int wmark_low;          // kswapd wakes below this many free frames
+  int wmark_high;         // and swaps out until this many are free
+  int free_frames;        // free frames now
+  uint64 zstores;         // pages swapped out to the compressed pool
+  uint64 zrejects;        // and to the disk, since they didn't compress
+  uint64 zwritebacks;     // pages the full pool wrote to the disk
+  uint64 zhits;           // pages swapped in from the pool
+  uint64 zmisses;         // and from the disk
+  int zpages;             // pages in the pool now
+  int zbytes;             // the bytes they take compressed
+};
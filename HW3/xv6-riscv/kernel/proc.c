@@ -6,6 +6,8 @@
 #include "proc.h"
 #include "defs.h"
 #include "fs.h"
+#include "pgstat.h"
+#include "pgpolicy.h"
 
 struct cpu cpus[NCPU];
 
@@ -16,8 +18,51 @@ struct proc *initproc;
 int nextpid = 1;
 struct spinlock pid_lock;
 
+#define NFRAME ((PHYSTOP - KERNBASE) / PGSIZE)
+
+struct frame frames[NFRAME];
+
+// The tracked pages of all processes, oldest first.
+struct {
+  struct spinlock lock;
+  struct frame head;           // list sentinel
+  int n;                       // tracked pages, busy ones included
+  int nretained;               // slots kept for clean copies of tracked pages
+  int full;                    // none could be swapped out, until a slot frees
+  int policy;                  // system-wide replacement policy, PGP_*
+  int npol[NPGPOLICY];         // tracked pages kept by each policy
+} ftab;
+
+// the replacement policy at boot, from SWAP_ALGO.
+#if defined(NFUA)
+#define PGP_BOOT PGP_NFUA
+#elif defined(LAPA)
+#define PGP_BOOT PGP_LAPA
+#elif defined(CLOCKPRO)
+#define PGP_BOOT PGP_CLOCKPRO
+#elif defined(ARC)
+#define PGP_BOOT PGP_ARC
+#else
+#define PGP_BOOT PGP_SCFIFO
+#endif
+
+// guards every p->swap_busy.
+struct spinlock swapbusy_lock;
+
+// system-wide paging counters.
+struct pgstat pgtotal;
+
+struct {
+  struct spinlock lock;
+  struct proc *proc;
+  int awake;                   // woken and not done yet
+} kswapd;
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void policy_map(struct frame *f);
+static void policy_unmap(struct frame *f, int out);
+static void policy_init(void);
 
 extern char trampoline[]; // trampoline.S
 
@@ -52,6 +97,10 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  initlock(&ftab.lock, "ftab");
+  ftab.head.next = ftab.head.prev = &ftab.head;
+  policy_init();
+  initlock(&swapbusy_lock, "swapbusy");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
@@ -125,6 +174,12 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->nminor = p->nmajor = p->nswapin = p->nswapout = p->nclean = 0;
+  p->nra = p->nrahit = p->nramiss = 0;
+  p->nrbytes = p->nwbytes = p->faultns = 0;
+  p->ra_window = 0;
+  p->ra_next = 0;
+  p->pgpolicy = PGP_DEFAULT;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -211,7 +266,7 @@ int shouldIgnore(struct proc * p)
   #ifdef NONE
     return 0;
   #endif
-  return p->pid > 2; // not init and not shell process
+  return p->pid > 3; // not init, kswapd or the shell process
 }
 
 // Free a process's page table, and free the
@@ -263,182 +318,245 @@ userinit(void)
   release(&p->lock);
 }
 
-void addToMemory(uint64 a)
+static struct frame*
+pa2frame(uint64 pa)
 {
-  struct proc *p = myproc();
-  if(!shouldIgnore(p))
-  {
-    return;
-  }
-
-  int unused_memory_index;
-  struct pageInMemory *pm;
-  if((unused_memory_index = unused_page_in_memory_index(p)) < 0)
-  {
-    int toSwap = swap_algo_page_index();
-    algo_file_swapout(toSwap);
-    unused_memory_index = toSwap;
-  }
-
-  pm = &p->pages_in_memory[unused_memory_index];
-  pm->virtual_address = a;
-  pm->used_unused = 1;
-
-  #ifdef LAPA
-  pm->age = 0xFFFFFFFF;
-  #endif
-
-  #ifndef LAPA
-  pm->age = 0;
-  #endif
+  if(pa < KERNBASE || pa >= PHYSTOP)
+    panic("pa2frame");
+  return &frames[(pa - KERNBASE) / PGSIZE];
 }
 
+// ftab.lock must be held.
+static void
+frame_link(struct frame *f)
+{
+  f->prev = ftab.head.prev;
+  f->next = &ftab.head;
+  ftab.head.prev->next = f;
+  ftab.head.prev = f;
+}
 
-// Grow or shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
-int
-growproc(int n)
+// ftab.lock must be held.
+static void
+frame_unlink(struct frame *f)
 {
-  uint64 sz;
-  struct proc *p = myproc();
+  f->prev->next = f->next;
+  f->next->prev = f->prev;
+  f->next = f->prev = 0;
+}
 
-  sz = p->sz;
-  if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
-      return -1;
-    }
-  } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+// the PTE of a tracked page, which is resident.
+static pte_t*
+frame_pte(struct frame *f)
+{
+  pte_t *pte;
+  if((pte = walk(f->owner->pagetable, f->va, 0)) == 0 || !(*pte & PTE_V))
+  {
+    panic("frame_pte");
   }
-  p->sz = sz;
-  return 0;
+  return pte;
 }
 
-int writeToSwapFile_(struct proc * p)
+// slot, if not -1, still holds a copy of the page; ra is set
+// if it was read ahead of a fault.
+static void
+frame_track(struct proc *p, uint64 va, uint64 pa, int slot, int ra)
 {
-  char* buff = (char*)kalloc();
-  for(struct pageInSwapfile *psf = p->pages_in_swapFile; psf < &p->pages_in_swapFile[MAX_PSYC_PAGES]; psf++)
+  struct frame *f = pa2frame(pa);
+
+  acquire(&ftab.lock);
+  if(f->owner)
+    panic("frame_track");
+  f->owner = p;
+  f->va = va;
+  f->busy = 0;
+  f->ra = ra;
+  f->slot = slot;
+  if(slot >= 0)
   {
-    if(writeToSwapFile(p,buff, psf->offset, PGSIZE) < 0)
-    {
-      return -1;
-    }
+    ftab.nretained++;
   }
-  kfree((void*)buff);
-  return 0;
+  frame_link(f);
+  ftab.n++;
+  policy_map(f);
+  release(&ftab.lock);
 }
 
-int forkCopyFile(struct proc * parent, struct proc * child)
+// Count a page read ahead as used or not, once its A bit is
+// looked at or it goes. ftab.lock must be held, or f be busy.
+static void
+frame_ra_settle(struct frame *f, pte_t pte)
 {
-  if(!parent)
+  if(!f->ra)
   {
-    return -1;
+    return;
   }
-  if(!child)
+  f->ra = 0;
+  if(pte & PTE_A)
   {
-    return -1;
+    __sync_fetch_and_add(&f->owner->nrahit, 1);
+    __sync_fetch_and_add(&pgtotal.ra_hits, 1);
   }
-  if(!parent->swapFile)
+  else
   {
-    return -1;
+    __sync_fetch_and_add(&f->owner->nramiss, 1);
+    __sync_fetch_and_add(&pgtotal.ra_misses, 1);
+  }
+}
+
+// ftab.lock and swap_lock(f->owner) must be held,
+// so f can't be busy.
+static void
+frame_untrack(struct frame *f)
+{
+  if(f->busy)
+    panic("frame_untrack");
+  frame_ra_settle(f, *frame_pte(f));
+  if(f->slot >= 0){
+    swapslot_free(f->slot);
+    ftab.nretained--;
+    f->slot = -1;
   }
-  if(!child->swapFile)
+  frame_unlink(f);
+  policy_unmap(f, 0);
+  f->owner = 0;
+  ftab.n--;
+}
+
+// Track the page at a, just mapped to pa in pagetable, if pagetable
+// is the current process's and its pages are swapped.
+void addToMemory(pagetable_t pagetable, uint64 a, uint64 pa)
+{
+  struct proc *p = myproc();
+  if(p == 0 || !shouldIgnore(p) || pagetable != p->pagetable)
   {
-    return -1;
+    return;
   }
+  frame_track(p, a, pa, -1, 0);
+}
+
+// Stop tracking all of p's pages, before its page table goes.
+// Caller holds swap_lock(p).
+void frames_release(struct proc *p)
+{
+  struct frame *f, *next;
 
-  char* buff = (char*)kalloc();
-  for(struct pageInSwapfile *psf = parent->pages_in_swapFile; psf < &parent->pages_in_swapFile[MAX_PSYC_PAGES]; psf++)
+  acquire(&ftab.lock);
+  for(f = ftab.head.next; f != &ftab.head; f = next)
   {
-    if(psf->used_unused)
+    next = f->next;
+    if(f->owner == p)
     {
-      if(readFromSwapFile(parent, buff, psf->offset, PGSIZE) < 0)
-      {
-        return -1;
-      }
-      if(writeToSwapFile(child, buff, psf->offset, PGSIZE) < 0)
-      {
-        return -1;
-      }
+      frame_untrack(f);
     }
   }
-  kfree((void*)buff);
-  return 0;
+  release(&ftab.lock);
 }
 
-int createSwapFile_(struct proc *p)
+// Track every resident user page of p, for a new image or child,
+// except those shared copy-on-write, until uvmcow() copies them.
+void frames_adopt(struct proc *p)
 {
-  if(!p->swapFile && createSwapFile(p) < 0)
-  {
-    return -1;
-  }
-  int i=0;
-  for(i=0; i< MAX_PSYC_PAGES; i++)
-  {
-    p->pages_in_swapFile[i].virtual_address = 0;
-    p->pages_in_swapFile[i].offset = 0;
-    p->pages_in_swapFile[i].used_unused = 0;
-  }
-  for(i=0; i< MAX_PSYC_PAGES; i++)
+  pte_t *pte;
+
+  for(uint64 va = 0; va < p->sz; va += PGSIZE)
   {
-    p->pages_in_memory[i].virtual_address = 0;
-    p->pages_in_memory[i].age = 0;
-    p->pages_in_memory[i].used_unused = 0;
+    if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V) && (*pte & PTE_U) &&
+       !(*pte & PTE_COW))
+    {
+      frame_track(p, va, PTE2PA(*pte), -1, 0);
+    }
   }
-  p->creation_order = 0;
-  return 0;
 }
 
-void removeSwapFile_(struct proc * p)
+// Serialize the swapping of p's pages: the PTEs of its tracked
+// pages and their slots. Held across disk I/O.
+void swap_lock(struct proc *p)
 {
-  int i=0;
-  if(p->swapFile && removeSwapFile(p) < 0)
+  acquire(&swapbusy_lock);
+  while(p->swap_busy)
   {
-    panic("removing swap file failed");
+    sleep(&p->swap_busy, &swapbusy_lock);
   }
-  p->swapFile = 0;
-  for(i=0; i< MAX_PSYC_PAGES; i++)
+  p->swap_busy = 1;
+  release(&swapbusy_lock);
+}
+
+static int swap_trylock(struct proc *p)
+{
+  int got;
+
+  acquire(&swapbusy_lock);
+  if((got = !p->swap_busy))
   {
-    p->pages_in_swapFile[i].virtual_address = 0;
-    p->pages_in_swapFile[i].offset = 0;
-    p->pages_in_swapFile[i].used_unused = 0;
+    p->swap_busy = 1;
   }
-  for(i=0; i< MAX_PSYC_PAGES; i++)
-  {
-    p->pages_in_memory[i].virtual_address = 0;
-    p->pages_in_memory[i].age = 0;
-    p->pages_in_memory[i].used_unused = 0;
+  release(&swapbusy_lock);
+  return got;
+}
+
+void swap_unlock(struct proc *p)
+{
+  acquire(&swapbusy_lock);
+  p->swap_busy = 0;
+  release(&swapbusy_lock);
+  wakeup(&p->swap_busy);
+}
+
+// Grow or shrink user memory by n bytes. New pages are
+// mapped by their first touch (uvmlazy()), unless eager.
+// Return 0 on success, -1 on failure.
+int
+growproc(int n, int eager)
+{
+  uint64 sz;
+  struct proc *p = myproc();
+
+  sz = p->sz;
+  if(n > 0){
+    if(sz + n > TRAPFRAME)
+      return -1;
+    if(!eager)
+      sz += n;
+    else if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+      return -1;
+    }
+  } else if(n < 0){
+    sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->creation_order = 0;
+  p->sz = sz;
+  return 0;
+}
+
+// Free a slot of the swap area, which may let a page go again.
+void swapslot_free(int slot)
+{
+  swap_free(slot);
+  ftab.full = 0;
 }
 
-void removeMemoryPage(uint64 virtual_address)
+// Stop tracking the page at virtual_address before it is unmapped
+// from pagetable. uvmunmap() frees its slot if it is swapped out.
+void removeMemoryPage(pagetable_t pagetable, uint64 virtual_address)
 {
   struct proc *p = myproc();
-  if(!shouldIgnore(p))
+  struct frame *f;
+  pte_t *pte;
+  if(!shouldIgnore(p) || pagetable != p->pagetable)
   {
     return;
   }
-  for(int i=0; i < MAX_PSYC_PAGES; i++)
-  {
-    if(p->pages_in_memory[i].virtual_address == virtual_address && p->pages_in_memory[i].used_unused)
-    {
-      p->pages_in_memory[i].virtual_address = 0;
-      p->pages_in_memory[i].age = 0;
-      p->pages_in_memory[i].used_unused = 0;
-      return;
-    }
-  }
-
-  for(int i=0; i < MAX_PSYC_PAGES; i++)
+  swap_lock(p);
+  if((pte = walk(pagetable, virtual_address, 0)) != 0 && (*pte & PTE_V))
   {
-    if(p->pages_in_swapFile[i].virtual_address == virtual_address && p->pages_in_swapFile[i].used_unused)
+    acquire(&ftab.lock);
+    if((f = pa2frame(PTE2PA(*pte)))->owner == p)
     {
-      p->pages_in_swapFile[i].virtual_address = 0;
-      p->pages_in_swapFile[i].used_unused = 0;
-      return;
+      frame_untrack(f);
     }
+    release(&ftab.lock);
   }
+  swap_unlock(p);
 }
 
 // Create a new process, copying the parent.
@@ -454,14 +572,25 @@ fork(void)
   if((np = allocproc()) == 0){
     return -1;
   }
+  // uvmcopy() may swap pages out, which sleeps. np stays USED,
+  // so nothing else uses it until it is RUNNABLE.
+  release(&np->lock);
 
-  // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // Copy user memory from parent to child. p's pages stay
+  // put while the child takes a share of its swap slots. A
+  // parent whose pages aren't swapped shares them copy-on-write.
+  if(shouldIgnore(p))
+    swap_lock(p);
+  if(uvmcopy(p->pagetable, np->pagetable, p->sz, !shouldIgnore(p)) < 0){
+    if(shouldIgnore(p))
+      swap_unlock(p);
+    acquire(&np->lock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
   np->sz = p->sz;
+  sfence_vma();
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -476,39 +605,22 @@ fork(void)
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
+  np->pgpolicy = p->pgpolicy;
 
   pid = np->pid;
 
-  release(&np->lock);
-
   acquire(&wait_lock);
   np->parent = p;
   release(&wait_lock);
 
-
-  if(shouldIgnore(np))
+  if(shouldIgnore(p))
   {
-    if(createSwapFile_(np) < 0){
-      freeproc(np);
-      return -1;
-    }
-    if(writeToSwapFile_(np) < 0)
-    {
-      freeproc(np);
-      return -1;
-    }
+    swap_unlock(p);
   }
 
-  if(shouldIgnore(p))
+  if(shouldIgnore(np))
   {
-    if(forkCopyFile(p, np) < 0){
-      freeproc(np);
-      removeSwapFile_(np);
-      return -1;
-    }
-    memmove(np->pages_in_memory, p->pages_in_memory, sizeof(p->pages_in_memory));
-    memmove(np->pages_in_swapFile, p->pages_in_swapFile, sizeof(p->pages_in_swapFile));
-    np->creation_order = p->creation_order;
+    frames_adopt(np);
   }
 
 
@@ -556,7 +668,9 @@ exit(int status)
 
   if(shouldIgnore(p))
   {
-    removeSwapFile_(p);
+    swap_lock(p);
+    frames_release(p);
+    swap_unlock(p);
   }
 
   begin_op();
@@ -590,7 +704,7 @@ int
 wait(uint64 addr)
 {
   struct proc *pp;
-  int havekids, pid;
+  int havekids, pid, xstate;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
@@ -607,19 +721,15 @@ wait(uint64 addr)
         if(pp->state == ZOMBIE){
           // Found one.
           pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
+          xstate = pp->xstate;
           freeproc(pp);
-          if(shouldIgnore(pp))
-          {
-            removeSwapFile_(pp);
-          }
           release(&pp->lock);
           release(&wait_lock);
+          // copied out with no locks held, in case the page
+          // it goes to has to be swapped in.
+          if(addr != 0 && copyout(p->pagetable, addr, (char *)&xstate,
+                                  sizeof(xstate)) < 0)
+            return -1;
           return pid;
         }
         release(&pp->lock);
@@ -637,24 +747,6 @@ wait(uint64 addr)
   }
 }
 
-void handle_age(struct proc * p)
-{
-  for(struct pageInMemory * pm = p->pages_in_memory; pm < &p->pages_in_memory[MAX_PSYC_PAGES]; pm++)
-  {
-    pte_t * pte;
-    if( (pte = walk(p->pagetable, pm->virtual_address, 0)) == 0 )
-    {
-        panic("walk failed");
-    }
-    pm->age = (pm->age >> 1);
-    if( *pte & PTE_A)
-    {
-      pm->age = pm->age | (1 << 31);
-      *pte = *pte & ~PTE_A;
-    }
-  }
-}
-
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -683,17 +775,6 @@ scheduler(void)
         c->proc = p;
         swtch(&c->context, &p->context);
 
-        // handle age
-        #ifdef NFUA
-            //printf("Scheduler nfua\n");
-            handle_age(p);
-        #endif
-
-        #ifdef LAPA
-            //printf("Scheduler lapa\n");
-            handle_age(p);
-        #endif
-
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
@@ -757,6 +838,7 @@ forkret(void)
     // be run from main().
     first = 0;
     fsinit(ROOTDEV);
+    swapinit();
   }
 
   usertrapret();
@@ -910,315 +992,1250 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    if(shouldIgnore(p))
+      printf(" faults %d/%d swap %d/%d kb %d/%d clean %d fault_us %d",
+             (int)p->nminor, (int)p->nmajor, (int)p->nswapin, (int)p->nswapout,
+             (int)(p->nrbytes / 1024), (int)(p->nwbytes / 1024),
+             (int)p->nclean, (int)(p->faultns / 1000));
     printf("\n");
   }
+  printf("paging: faults %d/%d swap %d/%d kb %d/%d clean %d fault_us %d\n",
+         (int)pgtotal.minor, (int)pgtotal.major, (int)pgtotal.swapins,
+         (int)pgtotal.swapouts, (int)(pgtotal.swap_rbytes / 1024),
+         (int)(pgtotal.swap_wbytes / 1024), (int)pgtotal.clean,
+         (int)(pgtotal.fault_ns / 1000));
+  printf("zswap: %d pages in %d bytes, stores %d rejects %d writebacks %d hits %d/%d\n",
+         pgtotal.zpages, pgtotal.zbytes, (int)pgtotal.zstores,
+         (int)pgtotal.zrejects, (int)pgtotal.zwritebacks, (int)pgtotal.zhits,
+         (int)(pgtotal.zhits + pgtotal.zmisses));
 }
 
-int unused_page_in_memory_index(struct proc * p)
+// Whether f's page may be swapped out now. Its owner must not be
+// running on another CPU, whose TLB can't be flushed from here, nor
+// be swapping, and there must be a slot for it: f's own, a free one,
+// or one kept for another clean page. ftab.lock must be held.
+static int evictable(struct frame *f)
 {
-  for(int i = 0; i< MAX_PSYC_PAGES; i++)
+  struct proc *q = f->owner;
+  if(q->swap_busy || (q->state == RUNNING && q != myproc()))
   {
-    if(!p->pages_in_memory[i].used_unused)
-    {
-      return i;
-    }
+    return 0;
   }
-  return -1;
+  return f->slot >= 0 || swap_nfree() > 0 || ftab.nretained > 0;
+}
+
+// Page replacement policies. Every tracked page is kept by the policy
+// of its owner (pgpolicy()), and all of them share the list in ftab,
+// each minding the order of its own pages only: a clock hand is the
+// front of the list, and a page it passes goes to the back. A victim
+// is asked of the policy of the process that needs a frame first,
+// then of the others. ftab.lock is held for all of these.
+struct pgpolicy {
+  void (*init)(void);                          // at boot
+  void (*on_map)(struct frame *f);             // f is tracked now
+  void (*on_access_scan)(struct frame *f);     // every AGE_TICKS ticks
+  struct frame* (*pick_victim)(void);          // an evictable page, or 0
+  void (*on_unmap)(struct frame *f, int out);  // f goes, swapped out if out
+};
+
+// f->flags, a policy's state of a page.
+#define FR_NEW   1   // its A bit is still the one of the fault that mapped it
+#define FR_HOT   2   // CLOCK-Pro: hot
+#define FR_TEST  4   // CLOCK-Pro: cold and in its test period
+#define FR_T2    8   // ARC: used again since it came in
+
+static int policy_of(struct proc *p)
+{
+  return p->pgpolicy != PGP_DEFAULT ? p->pgpolicy : ftab.policy;
+}
+
+// Move f to the back of the list, behind the hands.
+static void frame_requeue(struct frame *f)
+{
+  frame_unlink(f);
+  frame_link(f);
+}
+
+// the frame after f, going round, for a hand walking the list.
+static struct frame* frame_next(struct frame *f)
+{
+  f = f->next;
+  return f == &ftab.head ? ftab.head.next : f;
 }
 
-int unused_page_in_swapFile_index()
+// Whether f's page was used since this was last asked, which clears
+// its A bit.
+static int frame_used(struct frame *f)
 {
-  struct proc * p = myproc();
-  for(int i = 0; i< MAX_PSYC_PAGES; i++)
+  pte_t *pte = frame_pte(f);
+
+  if(!(*pte & PTE_A))
   {
-    if(!p->pages_in_swapFile[i].used_unused)
-    {
-      return i;
-    }
+    return 0;
   }
-  return -1;
+  frame_ra_settle(f, *pte);
+  __sync_fetch_and_and(pte, ~PTE_A);
+  return 1;
 }
 
+// the 1 bits in x, counted in parallel within the word.
+static int ones(uint x)
+{
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0F0F0F0F;
+  return (x * 0x01010101) >> 24;
+}
 
-int swapFile_page_virtualAddress(struct proc * p, uint64 virtual_addresss)
+// shift the age right, with a 1 on top if the page was used.
+static void age_scan(struct frame *f)
 {
-  for(int i = 0; i< MAX_PSYC_PAGES; i++)
+  f->age >>= 1;
+  if(frame_used(f))
   {
-    if(p->pages_in_swapFile[i].virtual_address == virtual_addresss)
-    {
-      return i;
-    }
+    f->age |= 1U << 31;
   }
-  return -1;
 }
 
+static void nfua_map(struct frame *f)
+{
+  f->age = 0;
+}
+
+static void lapa_map(struct frame *f)
+{
+  f->age = 0xFFFFFFFF;
+}
 
-int algo_nfua()
+// the lowest age.
+static struct frame* nfua_victim(void)
 {
-  struct proc * p = myproc();
-  int index_min = 0;
-  int age_min = 0xFFFFFFFF;
-  int i=0;
-  for(struct pageInMemory * pm = p->pages_in_memory; pm < &p->pages_in_memory[MAX_PSYC_PAGES]; pm++, i++)
+  struct frame *f, *min = 0;
+  for(f = ftab.head.next; f != &ftab.head; f = f->next)
   {
-    if( age_min >= pm->age)
+    if(f->pol == PGP_NFUA && evictable(f) && (min == 0 || f->age < min->age))
     {
-      age_min = pm->age;
-      index_min = i;
+      min = f;
     }
   }
-  return index_min;
+  return min;
 }
 
-int algo_lapa()
+// fewest 1 bits in the age, then the lowest age.
+static struct frame* lapa_victim(void)
 {
-  struct proc * p = myproc();
-  int index_min = 0;
-  int age_min = 0xFFFFFFFF;
-  int i=0;
-  for(struct pageInMemory * pm = p->pages_in_memory; pm < &p->pages_in_memory[MAX_PSYC_PAGES]; pm++, i++)
+  struct frame *f, *min = 0;
+  int n, minn = 0;
+  for(f = ftab.head.next; f != &ftab.head; f = f->next)
   {
-    // need to count ones in memory age
-    int pagesInMemoryAge = pm->age;
-    int countOneInMemory = 0;
-    while(pagesInMemoryAge > 0)
+    if(f->pol != PGP_LAPA || !evictable(f))
     {
-      int least_significant_bit = pagesInMemoryAge % 2;
-      countOneInMemory = countOneInMemory + least_significant_bit;
-      pagesInMemoryAge = pagesInMemoryAge / 2;
+      continue;
     }
-
-    // need to count ones in min age
-    int pagesInMemoryMinAge = 0xFFFFFFFF;
-    int countOneInMinAge = 0;
-    while(pagesInMemoryMinAge > 0)
+    n = ones(f->age);
+    if(min == 0 || n < minn || (n == minn && f->age < min->age))
     {
-      int least_significant_bit = pagesInMemoryMinAge % 2;
-      countOneInMinAge = countOneInMinAge + least_significant_bit;
-      pagesInMemoryMinAge = pagesInMemoryMinAge / 2;
+      min = f;
+      minn = n;
     }
+  }
+  return min;
+}
 
-    if(pagesInMemoryMinAge > countOneInMemory)
+// second chance over the pages of all processes: the oldest goes
+// unless it was accessed since it was last looked at, in which case
+// it moves to the back.
+static struct frame* scfifo_victim(void)
+{
+  struct frame *f, *next;
+  int i;
+  for(f = ftab.head.next, i = 0; f != &ftab.head && i < 2*ftab.n; f = next, i++)
+  {
+    next = frame_next(f);
+    if(f->pol != PGP_SCFIFO)
     {
-      index_min = i;
-      age_min = pm->age;
+      continue;
     }
-
-    if(pagesInMemoryMinAge == countOneInMemory && age_min > pm->age)
+    frame_requeue(f);
+    if(evictable(f) && !frame_used(f))
     {
-      index_min = i;
-      age_min = pm->age;
+      return f;
     }
   }
-  return index_min;
+  return 0;
 }
 
-int algo_scfifo()
+// Pages lately swapped out, by owner and address, oldest first, so
+// that CLOCK-Pro and ARC know a page that comes back soon.
+#define NGHOST NUSERFRAME
+
+struct ghosts {
+  int n;
+  struct {
+    int pid;
+    uint64 va;
+  } e[NGHOST];
+};
+
+// where f's page is in g, or -1.
+static int ghost_find(struct ghosts *g, struct frame *f)
 {
-  struct proc *p = myproc();
-  struct pageInMemory * pm;
-  int index = p->creation_order;
-  for(;;)
+  for(int i = 0; i < g->n; i++)
   {
-    pm = &p->pages_in_memory[index];
-    pte_t *pte;
-    if((pte = walk(p->pagetable, pm->virtual_address, 0)) == 0)
+    if(g->e[i].pid == f->owner->pid && g->e[i].va == f->va)
     {
-      panic("walk failed");
-    }
-
-    if (!(*pte & PTE_A))
-    {
-      p->creation_order = (index+1) % MAX_PSYC_PAGES;
-      return index;
-    }
-    else
-    {
-      *pte = *pte & ~PTE_A;
-      index = (index+1) % MAX_PSYC_PAGES;
+      return i;
     }
   }
+  return -1;
 }
 
-
-int swap_algo_page_index()
+static void ghost_del(struct ghosts *g, int i)
 {
-  //printf("here\n");
-  #ifdef NFUA
-    //printf("NFUA\n");
-    return algo_nfua();
-  #endif
-
-  #ifdef LAPA
-  //printf("LAPA\n");
-    return algo_lapa();
-  #endif
+  memmove(&g->e[i], &g->e[i+1], (g->n - i - 1) * sizeof(g->e[0]));
+  g->n--;
+}
 
-  #ifdef SCFIFO
-  //printf("SCFIFO\n");
-    return algo_scfifo();
-  #endif
+// Add f's page as the newest, dropping the oldest if g is full.
+// Returns whether one was dropped.
+static int ghost_add(struct ghosts *g, struct frame *f)
+{
+  int dropped = 0;
 
-  #ifdef NONE
-    return -1;
-  #endif
+  if(g->n == NGHOST)
+  {
+    ghost_del(g, 0);
+    dropped = 1;
+  }
+  g->e[g->n].pid = f->owner->pid;
+  g->e[g->n].va = f->va;
+  g->n++;
+  return dropped;
+}
 
-  return -1;
+// CLOCK-Pro (Jiang, Chen and Zhang, USENIX '05): a page used again
+// soon after it came in is hot, and the cold hand only evicts cold
+// ones. A cold page is on test from when it comes in until the hot
+// hand passes it. Used again on test it turns hot, and if that was
+// while it was out the target of cold pages, mc, grows; a test that
+// ends unused shrinks it. The hot hand cools the hot pages it finds
+// unused while there are more than NUSERFRAME - mc.
+static struct {
+  int mc;                      // target of resident cold pages
+  int nhot;                    // resident hot pages
+  struct ghosts test;          // swapped out, still on test
+} clockpro;
+
+static void clockpro_init(void)
+{
+  clockpro.mc = NUSERFRAME / 4;
 }
 
-void algo_file_swapout(int page_memory_index)
+// the hot hand.
+static void clockpro_cool(void)
 {
-  struct proc *p = myproc();
-  if(page_memory_index < 0 || page_memory_index >= MAX_PSYC_PAGES)
+  struct frame *f, *next;
+  int i;
+  for(f = ftab.head.next, i = 0;
+      f != &ftab.head && i < 2*ftab.n && clockpro.nhot > NUSERFRAME - clockpro.mc;
+      f = next, i++)
   {
-    panic("reached max memory pages");
+    next = frame_next(f);
+    if(f->pol != PGP_CLOCKPRO)
+    {
+      continue;
+    }
+    frame_requeue(f);
+    if((f->flags & FR_HOT) && !frame_used(f))
+    {
+      f->flags &= ~FR_HOT;
+      clockpro.nhot--;
+    }
+    else if(f->flags & FR_TEST)
+    {
+      f->flags &= ~FR_TEST;
+      if(clockpro.mc > 1)
+      {
+        clockpro.mc--;
+      }
+    }
   }
-  struct pageInMemory * pm = &p->pages_in_memory[page_memory_index];
+}
 
-  if(!pm->used_unused)
-  {
-    panic("page unused");
-  }
+static void clockpro_map(struct frame *f)
+{
+  int i = ghost_find(&clockpro.test, f);
 
-  pte_t * pte;
-  if( ( pte = walk(p->pagetable, pm->virtual_address, 0)) == 0)
+  if(i >= 0)
   {
-    panic("walk failed");
+    ghost_del(&clockpro.test, i);
   }
-  if(!(*pte & PTE_V) || (*pte & PTE_PG))
+  if(i >= 0 && !f->ra)
   {
-    panic("page not in memory");
+    if(clockpro.mc < NUSERFRAME - 1)
+    {
+      clockpro.mc++;
+    }
+    f->flags = FR_HOT;
+    clockpro.nhot++;
+    clockpro_cool();
+    return;
   }
+  f->flags = FR_NEW | FR_TEST;
+}
 
-  int page_swapFile_index;
-  if((page_swapFile_index = unused_page_in_swapFile_index()) < 0)
+// the cold hand.
+static struct frame* clockpro_victim(void)
+{
+  struct frame *f, *next;
+  int i;
+  for(f = ftab.head.next, i = 0; f != &ftab.head && i < 3*ftab.n; f = next, i++)
   {
-    panic("reached max swapFile pages");
+    next = frame_next(f);
+    if(f->pol != PGP_CLOCKPRO || (f->flags & FR_HOT))
+    {
+      continue;
+    }
+    frame_requeue(f);
+    if(!evictable(f))
+    {
+      continue;
+    }
+    if(!frame_used(f))
+    {
+      return f;
+    }
+    if(f->flags & FR_NEW)
+    {
+      f->flags &= ~FR_NEW;
+    }
+    else if(f->flags & FR_TEST)
+    {
+      f->flags = FR_HOT;
+      clockpro.nhot++;
+      clockpro_cool();
+    }
+    else
+    {
+      f->flags |= FR_TEST;
+    }
   }
-
-  struct pageInSwapfile * psf = &p->pages_in_swapFile[page_swapFile_index];
-  uint64 physicalAddress = PTE2PA(*pte);
-  if(writeToSwapFile(p,(char*)physicalAddress, psf->offset, PGSIZE) < 0 )
+  // no cold page can go: a hot one does.
+  for(f = ftab.head.next; f != &ftab.head; f = f->next)
   {
-    panic("writeToSwapFile failed");
+    if(f->pol == PGP_CLOCKPRO && evictable(f))
+    {
+      return f;
+    }
   }
-  psf->virtual_address = pm->virtual_address;
-  psf->used_unused = 1;
-  kfree((void*)physicalAddress);
-
-  pm->used_unused = 0;
-  pm->virtual_address = 0;
-
-  *pte = *pte & ~PTE_V;
-  // to secondary storage
-  *pte = *pte | PTE_PG;
-  /// flush the TLB.
-  sfence_vma();
+  return 0;
 }
 
-void algo_file_swapin(int swapFile_index, int memory_index)
+static void clockpro_unmap(struct frame *f, int out)
 {
-  if(swapFile_index < 0 || swapFile_index >= MAX_PSYC_PAGES)
+  if(f->flags & FR_HOT)
   {
-    panic("reached max swap file pages");
+    clockpro.nhot--;
   }
-
-  if(memory_index < 0 || memory_index >= MAX_PSYC_PAGES)
+  else if(out && (f->flags & FR_TEST) &&
+          ghost_add(&clockpro.test, f) && clockpro.mc > 1)
   {
-    panic("reached max memory pages");
+    // the oldest test ended unused.
+    clockpro.mc--;
   }
+}
 
-  struct proc * p = myproc();
-  struct pageInSwapfile *  psf = &p->pages_in_swapFile[swapFile_index];
-
-  if(!psf->used_unused)
-  {
-    panic("page in swap file is unused");
-  }
+// ARC (Megiddo and Modha, FAST '03), run as CAR (Bansal and Modha,
+// FAST '04) since the hardware sets A bits rather than tell of every
+// use: T1 holds the pages not used again since they came in and T2
+// the others, each a clock, and the ghost lists B1 and B2 the pages
+// lately evicted from each. A page that comes back from B1 moves the
+// target size of T1, p, up, and one from B2 moves it down.
+static struct {
+  int p;                       // target size of T1
+  int n1, n2;                  // resident pages in T1 and T2
+  struct ghosts b1, b2;
+} arc;
+
+static void arc_map(struct frame *f)
+{
+  int i1 = ghost_find(&arc.b1, f);
+  int i2 = ghost_find(&arc.b2, f);
+  int d;
 
-  pte_t *pte;
-  if((pte = walk(p->pagetable, psf->virtual_address,0)) == 0)
+  if(!f->ra && i1 >= 0)
   {
-    panic("not valid pte (unallocated)");
+    d = arc.b2.n > arc.b1.n ? arc.b2.n / arc.b1.n : 1;
+    arc.p = arc.p + d < NUSERFRAME ? arc.p + d : NUSERFRAME;
+    f->flags = FR_T2;
+    arc.n2++;
   }
-  if((*pte & PTE_V) || !(*pte & PTE_PG))
+  else if(!f->ra && i2 >= 0)
   {
-    panic("page not in swap file");
+    d = arc.b1.n > arc.b2.n ? arc.b1.n / arc.b2.n : 1;
+    arc.p = arc.p > d ? arc.p - d : 0;
+    f->flags = FR_T2;
+    arc.n2++;
   }
-
-  struct pageInMemory * pm = &p->pages_in_memory[memory_index];
-  if(pm->used_unused)
+  else
   {
-    panic("page in memory is used");
+    // new to both: keep T1 and B1, and all four lists, within
+    // one and two times the frames.
+    if(i1 < 0 && i2 < 0)
+    {
+      if(arc.n1 + arc.b1.n >= NUSERFRAME && arc.b1.n > 0)
+      {
+        ghost_del(&arc.b1, 0);
+      }
+      else if(arc.n1 + arc.n2 + arc.b1.n + arc.b2.n >= 2*NUSERFRAME && arc.b2.n > 0)
+      {
+        ghost_del(&arc.b2, 0);
+      }
+    }
+    f->flags = FR_NEW;
+    arc.n1++;
   }
+  if(i1 >= 0)
+  {
+    ghost_del(&arc.b1, i1);
+  }
+  if(i2 >= 0)
+  {
+    ghost_del(&arc.b2, i2);
+  }
+}
 
-  uint64 buff;
-  if ( (buff = (uint64)kalloc() ) == 0 )
+// T1's hand while T1 is at least its target, else T2's.
+static struct frame* arc_victim(void)
+{
+  struct frame *f, *next;
+  int i, t2;
+  for(f = ftab.head.next, i = 0; f != &ftab.head && i < 3*ftab.n; f = next, i++)
   {
-    panic("memory allocation failed");
+    next = frame_next(f);
+    t2 = arc.n1 < (arc.p > 1 ? arc.p : 1);
+    if(f->pol != PGP_ARC || !(f->flags & FR_T2) != !t2)
+    {
+      continue;
+    }
+    frame_requeue(f);
+    if(!evictable(f))
+    {
+      continue;
+    }
+    if(!frame_used(f))
+    {
+      return f;
+    }
+    if(f->flags & FR_NEW)
+    {
+      f->flags &= ~FR_NEW;
+    }
+    else if(!(f->flags & FR_T2))
+    {
+      f->flags |= FR_T2;
+      arc.n1--;
+      arc.n2++;
+    }
+  }
+  // nothing in that list can go: anything that can.
+  for(f = ftab.head.next; f != &ftab.head; f = f->next)
+  {
+    if(f->pol == PGP_ARC && evictable(f))
+    {
+      return f;
+    }
   }
+  return 0;
+}
 
-  if(readFromSwapFile(p, (char*)buff, psf->offset, PGSIZE) < 0)
+static void arc_unmap(struct frame *f, int out)
+{
+  if(f->flags & FR_T2)
   {
-    panic("read from file failed");
+    arc.n2--;
+    if(out)
+    {
+      ghost_add(&arc.b2, f);
+    }
   }
+  else
+  {
+    arc.n1--;
+    if(out)
+    {
+      ghost_add(&arc.b1, f);
+    }
+  }
+}
 
-  
-  pm->virtual_address = psf->virtual_address;
-  pm->used_unused = 1;
+static struct pgpolicy pgpolicies[NPGPOLICY] = {
+  [PGP_SCFIFO]   { 0, 0, 0, scfifo_victim, 0 },
+  [PGP_NFUA]     { 0, nfua_map, age_scan, nfua_victim, 0 },
+  [PGP_LAPA]     { 0, lapa_map, age_scan, lapa_victim, 0 },
+  [PGP_CLOCKPRO] { clockpro_init, clockpro_map, 0, clockpro_victim, clockpro_unmap },
+  [PGP_ARC]      { 0, arc_map, 0, arc_victim, arc_unmap },
+};
 
-  #ifdef LAPA
-  pm->age = 0xFFFFFFFF;
-  #endif
+// from procinit().
+static void policy_init(void)
+{
+  ftab.policy = PGP_BOOT;
+  for(int i = 0; i < NPGPOLICY; i++)
+  {
+    if(pgpolicies[i].init)
+    {
+      pgpolicies[i].init();
+    }
+  }
+}
 
-  #ifndef LAPA
-  pm->age = 0;
-  #endif
+// Give tracked page f to the policy of its owner.
+static void policy_map(struct frame *f)
+{
+  f->pol = policy_of(f->owner);
+  f->flags = 0;
+  ftab.npol[f->pol]++;
+  if(pgpolicies[f->pol].on_map)
+  {
+    pgpolicies[f->pol].on_map(f);
+  }
+}
 
-  psf->used_unused = 0;
-  psf->virtual_address = 0;
-  
-  *pte = *pte | PTE_V;
-  *pte = *pte & ~PTE_PG;
-  // using buff , update pte 
-  *pte = PA2PTE(buff) | PTE_FLAGS(*pte);
-  // flush TLB
+// Take f from its policy, as it is untracked, swapped out if out.
+static void policy_unmap(struct frame *f, int out)
+{
+  if(pgpolicies[f->pol].on_unmap)
+  {
+    pgpolicies[f->pol].on_unmap(f, out);
+  }
+  ftab.npol[f->pol]--;
+}
+
+// Give f to its owner's policy if that is another one now.
+static void frame_rehome(struct frame *f)
+{
+  if(f->pol != policy_of(f->owner))
+  {
+    policy_unmap(f, 0);
+    policy_map(f);
+  }
+}
+
+// the tick the next scan of A bits is due at.
+static uint age_next;
+
+// From the timer interrupt of every CPU. Every AGE_TICKS ticks, the
+// first CPU to see it due lets the policies look at the A bits of
+// all tracked pages in one pass. Clearing A needs no TLB flush: a
+// hart whose TLB still holds the page flushes it on its next trap
+// (trampoline.S), and A is set again on the next use after that.
+void aging_tick(void)
+{
+  struct frame *f;
+  int n = 0;
+
+  // hints, read without the lock.
+  if((int)(ticks - age_next) < 0)
+  {
+    return;
+  }
+  for(int i = 0; i < NPGPOLICY; i++)
+  {
+    if(pgpolicies[i].on_access_scan)
+    {
+      n += ftab.npol[i];
+    }
+  }
+  if(n == 0)
+  {
+    return;
+  }
+  acquire(&ftab.lock);
+  if((int)(ticks - age_next) < 0)
+  {
+    release(&ftab.lock);
+    return;
+  }
+  age_next = ticks + AGE_TICKS;
+  for(f = ftab.head.next; f != &ftab.head; f = f->next)
+  {
+    if(pgpolicies[f->pol].on_access_scan)
+    {
+      pgpolicies[f->pol].on_access_scan(f);
+    }
+  }
+  release(&ftab.lock);
+}
+
+// ftab.lock must be held.
+static struct frame* swap_algo_victim(void)
+{
+  struct proc *p = myproc();
+  int first = p ? policy_of(p) : ftab.policy;
+  struct frame *f;
+
+  if((f = pgpolicies[first].pick_victim()) != 0)
+  {
+    return f;
+  }
+  for(int i = 0; i < NPGPOLICY; i++)
+  {
+    if(i != first && ftab.npol[i] > 0 && (f = pgpolicies[i].pick_victim()) != 0)
+    {
+      return f;
+    }
+  }
+  return 0;
+}
+
+// Set the page replacement policy of process pid, or the system-wide
+// one if pid is 0, to policy, or only read it if policy is PGP_GET.
+// A process given PGP_DEFAULT follows the system-wide one. Pages move
+// to their new policy at once. Returns the old policy, or -1.
+int pgpolicy(int pid, int policy)
+{
+  struct proc *q = 0;
+  struct frame *f;
+  int old;
+
+  if(policy < 0 || policy > PGP_GET || (pid == 0 && policy == PGP_DEFAULT))
+  {
+    return -1;
+  }
+  if(pid != 0)
+  {
+    for(q = proc; q < &proc[NPROC]; q++)
+    {
+      acquire(&q->lock);
+      if(q->state != UNUSED && q->pid == pid)
+      {
+        break;
+      }
+      release(&q->lock);
+    }
+    if(q == &proc[NPROC])
+    {
+      return -1;
+    }
+  }
+  acquire(&ftab.lock);
+  if(q)
+  {
+    old = q->pgpolicy;
+    if(policy != PGP_GET)
+    {
+      q->pgpolicy = policy;
+    }
+  }
+  else
+  {
+    old = ftab.policy;
+    if(policy != PGP_GET)
+    {
+      ftab.policy = policy;
+    }
+  }
+  // busy ones too, which are off the list.
+  for(f = frames; f < &frames[NFRAME]; f++)
+  {
+    if(f->owner)
+    {
+      frame_rehome(f);
+    }
+  }
+  release(&ftab.lock);
+  if(q)
+  {
+    release(&q->lock);
+  }
+  return old;
+}
+
+// Put batch[lo..n-1] back on the list after a swap out that
+// didn't happen.
+static void frames_putback(struct frame **batch, int lo, int n)
+{
+  acquire(&ftab.lock);
+  for(int i = lo; i < n; i++)
+  {
+    batch[i]->busy = 0;
+    frame_link(batch[i]);
+  }
+  release(&ftab.lock);
+}
+
+// Take victim f and the pages of its owner q that follow it in q's
+// address space off the list, into batch, up to SWAP_CLUSTER in all.
+// The others must be resident, tracked and unused since they were
+// last looked at. ftab.lock must be held, and swap_lock(q), which
+// keeps q's page table.
+static int cluster(struct frame *f, struct frame **batch)
+{
+  struct proc *q = f->owner;
+  struct frame *g = f;
+  pte_t *pte;
+  uint64 va;
+  int n = 0;
+
+  for(;;)
+  {
+    frame_unlink(g);
+    g->busy = 1;
+    batch[n++] = g;
+    va = f->va + n*PGSIZE;
+    if(n == SWAP_CLUSTER || va >= q->sz || (pte = walk(q->pagetable, va, 0)) == 0 ||
+       (*pte & (PTE_V | PTE_U | PTE_A)) != (PTE_V | PTE_U))
+    {
+      break;
+    }
+    g = pa2frame(PTE2PA(*pte));
+    if(g->owner != q || g->busy || g->ra)
+    {
+      break;
+    }
+  }
+  return n;
+}
+
+// Take the slot kept for a clean resident page of any process, when
+// the swap area is full otherwise, or -1. The page is written to a
+// slot again if it goes out. A slot shared after fork can't be
+// written, so it isn't taken.
+static int swapslot_steal(void)
+{
+  struct frame *f;
+  int slot = -1;
+
+  acquire(&ftab.lock);
+  for(f = ftab.head.next; f != &ftab.head; f = f->next)
+  {
+    if(f->slot >= 0 && !swap_shared(f->slot))
+    {
+      slot = f->slot;
+      f->slot = -1;
+      ftab.nretained--;
+      break;
+    }
+  }
+  release(&ftab.lock);
+  return slot;
+}
+
+// Swap out a tracked page of any process, chosen by SWAP_ALGO, with
+// the unused pages that follow it (cluster()). A page that still has
+// its copy in the swap area and wasn't written since it came in is
+// dropped without a write. The others go to adjacent slots in one
+// write, so that read ahead brings them back together.
+// Returns how many pages went, 0 if none could.
+static int reclaim(void)
+{
+  struct frame *batch[SWAP_CLUSTER], *f;
+  struct proc *q;
+  pte_t *pte[SWAP_CLUSTER];
+  uint64 pa[SWAP_CLUSTER];
+  char *page[SWAP_CLUSTER];
+  int slot[SWAP_CLUSTER], clean[SWAP_CLUSTER];
+  int n, i, k, ndirty, first, got;
+
+  for(int tries = 0; tries < 8; tries++)
+  {
+    acquire(&ftab.lock);
+    if((f = swap_algo_victim()) == 0)
+    {
+      ftab.full = 1;
+      release(&ftab.lock);
+      return 0;
+    }
+    q = f->owner;
+    if(!swap_trylock(q))
+    {
+      release(&ftab.lock);
+      continue;
+    }
+    n = cluster(f, batch);
+    release(&ftab.lock);
+
+    // q can't start running while its lock is held, and it finds
+    // the PTEs invalid once it does.
+    acquire(&q->lock);
+    if(q->state == RUNNING && q != myproc())
+    {
+      release(&q->lock);
+      frames_putback(batch, 0, n);
+      swap_unlock(q);
+      continue;
+    }
+    ndirty = 0;
+    for(i = 0; i < n; i++)
+    {
+      pte[i] = frame_pte(batch[i]);
+      pa[i] = PTE2PA(*pte[i]);
+      clean[i] = batch[i]->slot >= 0 && !(*pte[i] & PTE_D);
+      ndirty += !clean[i];
+    }
+    // the dirty pages get a run of adjacent slots, as long as a free
+    // one is found. With no slot free, the victim alone goes, to its
+    // own slot unless shared, or one kept for a clean page.
+    got = 0;
+    first = -1;
+    if(ndirty > 0 && (first = swap_alloc_run(ndirty, &got)) < 0 && !clean[0])
+    {
+      if(((first = batch[0]->slot) < 0 || swap_shared(first)) &&
+         (first = swapslot_steal()) < 0)
+      {
+        release(&q->lock);
+        frames_putback(batch, 0, n);
+        swap_unlock(q);
+        continue;
+      }
+      got = 1;
+    }
+    for(i = 0, k = 0; i < n; i++)
+    {
+      if(clean[i])
+      {
+        slot[i] = batch[i]->slot;
+        continue;
+      }
+      if(k == got)
+      {
+        break;
+      }
+      slot[i] = first + k;
+      page[k++] = (char*)pa[i];
+    }
+    frames_putback(batch, i, n);
+    n = i;
+    for(i = 0; i < n; i++)
+    {
+      frame_ra_settle(batch[i], *pte[i]);
+      *pte[i] = SLOT2PTE(slot[i]) | (PTE_FLAGS(*pte[i]) & ~PTE_V) | PTE_PG;
+    }
+    release(&q->lock);
+    if(q == myproc())
+    {
+      sfence_vma();
+    }
+
+    if(k > 0 && swapio(first, page, k, 1) < 0)
+    {
+      for(i = 0; i < n; i++)
+      {
+        *pte[i] = PA2PTE(pa[i]) | ((PTE_FLAGS(*pte[i]) | PTE_V) & ~PTE_PG);
+        if(slot[i] != batch[i]->slot)
+        {
+          swapslot_free(slot[i]);
+        }
+      }
+      frames_putback(batch, 0, n);
+      swap_unlock(q);
+      continue;
+    }
+    acquire(&ftab.lock);
+    for(i = 0; i < n; i++)
+    {
+      f = batch[i];
+      if(f->slot >= 0)
+      {
+        // a clean page's slot now belongs to its PTE. A dirty
+        // page's old copy is stale, unless it was rewritten.
+        if(f->slot != slot[i])
+        {
+          swapslot_free(f->slot);
+        }
+        f->slot = -1;
+        ftab.nretained--;
+      }
+      policy_unmap(f, 1);
+      f->owner = 0;
+      f->busy = 0;
+      ftab.n--;
+    }
+    release(&ftab.lock);
+    for(i = 0; i < n; i++)
+    {
+      kfree((void*)pa[i]);
+    }
+    __sync_fetch_and_add(&q->nswapout, n);
+    __sync_fetch_and_add(&pgtotal.swapouts, n);
+    __sync_fetch_and_add(&q->nclean, n - k);
+    __sync_fetch_and_add(&pgtotal.clean, n - k);
+    __sync_fetch_and_add(&q->nwbytes, (uint64)k * PGSIZE);
+    __sync_fetch_and_add(&pgtotal.swap_wbytes, (uint64)k * PGSIZE);
+    if(myproc() == kswapd.proc)
+    {
+      __sync_fetch_and_add(&pgtotal.kswapd_pages, n);
+    }
+    else
+    {
+      __sync_fetch_and_add(&pgtotal.direct_pages, n);
+    }
+    swap_unlock(q);
+    return n;
+  }
+  return 0;
+}
+
+// free frames: how many more pages can be handed out before the
+// tracked pages reach NUSERFRAME or free memory KRESERVE.
+static int headroom(void)
+{
+  int budget = NUSERFRAME - ftab.n;
+  int mem = kfreepages() - KRESERVE;
+  return budget < mem ? budget : mem;
+}
+
+static void kswapd_wake(void)
+{
+  acquire(&kswapd.lock);
+  if(kswapd.awake)
+  {
+    release(&kswapd.lock);
+    return;
+  }
+  kswapd.awake = 1;
+  release(&kswapd.lock);
+  wakeup(&kswapd);
+  __sync_fetch_and_add(&pgtotal.kswapd_wakeups, 1);
+}
+
+// Allocate a page for user memory. kswapd is woken below KSWAPD_LOW
+// free frames; with none left, pages of any process are swapped out
+// here first. If none can go, say the swap area is full, the
+// allocation goes ahead without, and later ones don't search again
+// until a slot is freed.
+void* ualloc(void)
+{
+  while(!ftab.full && headroom() <= 0)
+  {
+    if(!reclaim())
+    {
+      break;
+    }
+  }
+  if(!ftab.full && !kswapd.awake && headroom() < KSWAPD_LOW)
+  {
+    kswapd_wake();
+  }
+  return kalloc();
+}
+
+// kswapd swaps pages out ahead of the faults that need the frames:
+// once woken it goes on until KSWAPD_HIGH frames are free, giving
+// up the CPU every KSWAPD_BATCH pages.
+static void kswapd_main(void)
+{
+  int n, got;
+
+  // still holding p->lock from scheduler().
+  release(&myproc()->lock);
+
+  acquire(&kswapd.lock);
+  for(;;)
+  {
+    while(!kswapd.awake)
+    {
+      sleep(&kswapd, &kswapd.lock);
+    }
+    release(&kswapd.lock);
+    n = 0;
+    while(!ftab.full && headroom() < KSWAPD_HIGH && (got = reclaim()) > 0)
+    {
+      if((n += got) >= KSWAPD_BATCH)
+      {
+        n = 0;
+        yield();
+      }
+    }
+    acquire(&kswapd.lock);
+    kswapd.awake = 0;
+  }
+}
+
+// Start kswapd, a process that only runs in the kernel. It comes
+// right after userinit(), so it is pid 2 and the shell pid 3.
+void kswapdinit(void)
+{
+  struct proc *p;
+
+  initlock(&kswapd.lock, "kswapd");
+  if((p = allocproc()) == 0)
+  {
+    panic("kswapdinit");
+  }
+  p->context.ra = (uint64)kswapd_main;
+  safestrcpy(p->name, "kswapd", sizeof(p->name));
+  kswapd.proc = p;
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
+// Read n pages at va, va+PGSIZE, ... back from the swap area into
+// mem[0..n-1], with a disk request for each run of adjacent slots.
+// The pages after the first are read ahead of a fault. The copy in
+// a slot is kept for as long as its page stays clean.
+// Caller holds swap_lock(p).
+static int swapin(struct proc *p, uint64 va, pte_t **pte, char **mem, int n)
+{
+  int i, j, slot;
+
+  for(i = 0; i < n; i = j)
+  {
+    slot = PTE2SLOT(*pte[i]);
+    for(j = i + 1; j < n && PTE2SLOT(*pte[j]) == slot + (j - i); j++)
+      ;
+    if(swapio(slot, mem + i, j - i, 0) < 0)
+    {
+      return -1;
+    }
+  }
+  for(i = 0; i < n; i++)
+  {
+    // the slot stays with the page, which is clean until written.
+    // A page read ahead starts unused, to tell if it gets used.
+    slot = PTE2SLOT(*pte[i]);
+    *pte[i] = PA2PTE(mem[i]) | ((PTE_FLAGS(*pte[i]) | PTE_V) & ~(PTE_PG | PTE_D));
+    if(i > 0)
+    {
+      *pte[i] &= ~PTE_A;
+    }
+    frame_track(p, va + i*PGSIZE, (uint64)mem[i], slot, i > 0);
+  }
   sfence_vma();
+  __sync_fetch_and_add(&p->nswapin, n);
+  __sync_fetch_and_add(&pgtotal.swapins, n);
+  __sync_fetch_and_add(&p->nrbytes, (uint64)n * PGSIZE);
+  __sync_fetch_and_add(&pgtotal.swap_rbytes, (uint64)n * PGSIZE);
+  __sync_fetch_and_add(&p->nra, n - 1);
+  __sync_fetch_and_add(&pgtotal.ra_pages, n - 1);
+  return 0;
+}
 
+// Pick how many pages to read ahead of a fault at va: the window
+// doubles while faults come right after the pages last read ahead,
+// and halves when one comes anywhere else.
+static int ra_window(struct proc *p, uint64 va)
+{
+  if(va == p->ra_next)
+  {
+    p->ra_window = p->ra_window ? 2 * p->ra_window : 1;
+    if(p->ra_window > RA_MAX)
+    {
+      p->ra_window = RA_MAX;
+    }
+  }
+  else
+  {
+    p->ra_window /= 2;
+  }
+  return p->ra_window;
 }
 
-void dealWithPageFault(uint64 virtual_addresss)
+// Swap in the page the current process faulted on, along with the
+// swapped out pages that follow it, as many as the read-ahead window
+// and the free frames allow. Returns -1 if it isn't a swapped out
+// page, and the process should be killed, 1 if it read the page from
+// swap, and 0 if it found it there already.
+int dealWithPageFault(uint64 virtual_addresss)
 {
-   struct proc *p = myproc();
-   pte_t * pte;
-   if(!(pte=walk(p->pagetable, virtual_addresss, 0)))
-   {
-    panic("walk failed");
-   }
+  struct proc *p = myproc();
+  uint64 va = PGROUNDDOWN(virtual_addresss);
+  pte_t *pte[1 + RA_MAX];
+  char *mem[1 + RA_MAX];
+  int n, window;
 
-   if(*pte & PTE_V)
-   {
-    panic("not valid pte");
-   }
+  if(va >= MAXVA || (pte[0] = walk(p->pagetable, va, 0)) == 0)
+  {
+    return -1;
+  }
+  // a hart that faults rather than set A and D itself (Svade).
+  if((*pte[0] & PTE_V) && (*pte[0] & PTE_U) &&
+     (!(*pte[0] & PTE_A) || ((*pte[0] & PTE_W) && !(*pte[0] & PTE_D))))
+  {
+    *pte[0] |= PTE_A | ((*pte[0] & PTE_W) ? PTE_D : 0);
+    sfence_vma();
+    return 0;
+  }
+  // only p swaps its pages in, so a swapped out PTE stays that way.
+  if((*pte[0] & PTE_V) || !(*pte[0] & PTE_PG))
+  {
+    return -1;
+  }
+  if((mem[0] = ualloc()) == 0)
+  {
+    return -1;
+  }
+  swap_lock(p);
+  if(*pte[0] & PTE_V)
+  {
+    // put back by a swap out that failed while p waited.
+    swap_unlock(p);
+    kfree(mem[0]);
+    return 0;
+  }
+  // read ahead only into frames that are free already.
+  window = ra_window(p, va);
+  for(n = 1; n <= window; n++)
+  {
+    uint64 a = va + n*PGSIZE;
+    if(a >= p->sz || (pte[n] = walk(p->pagetable, a, 0)) == 0 ||
+       !(*pte[n] & PTE_PG) || headroom() <= 0 || (mem[n] = kalloc()) == 0)
+    {
+      break;
+    }
+  }
+  if(swapin(p, va, pte, mem, n) < 0)
+  {
+    swap_unlock(p);
+    for(int i = 0; i < n; i++)
+    {
+      kfree(mem[i]);
+    }
+    return -1;
+  }
+  p->ra_next = va + n*PGSIZE;
+  swap_unlock(p);
+  return 1;
+}
+
+// Count a page fault of p that began at time t0 (r_time()), major
+// if it read from swap.
+void pgfault_count(struct proc *p, int major, uint64 t0)
+{
+  // qemu virt's time CSR runs at 10MHz.
+  uint64 ns = (r_time() - t0) * 100;
+
+  if(major)
+  {
+    __sync_fetch_and_add(&p->nmajor, 1);
+    __sync_fetch_and_add(&pgtotal.major, 1);
+  }
+  else
+  {
+    __sync_fetch_and_add(&p->nminor, 1);
+    __sync_fetch_and_add(&pgtotal.minor, 1);
+  }
+  __sync_fetch_and_add(&p->faultns, ns);
+  __sync_fetch_and_add(&pgtotal.fault_ns, ns);
+}
+
+// Whether copyin() and copyout() on pagetable must pin its pages: it
+// is the current process's, whose pages can be swapped out, and the
+// caller holds no spinlock. Under a spinlock the process can't
+// sleep, nor be preempted, so its pages stay, but can't come in.
+static int must_pin(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+  int noff;
 
-   if(!(*pte & PTE_PG))
-   {
-    panic("PTE_PG");
-   }
+  if(p == 0 || !shouldIgnore(p) || pagetable != p->pagetable)
+  {
+    return 0;
+  }
+  push_off();
+  noff = mycpu()->noff;
+  pop_off();
+  return noff == 1;
+}
 
+// walkaddr() for copyin() and copyout(): swaps the page in if it is
+// out, or maps it if sbrk() left it for the first touch, and keeps
+// it in memory until unpinpage().
+uint64 pinpage(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+  pte_t *pte;
+  char *mem;
 
-  int pages_memory_unused;
-  if( (pages_memory_unused = unused_page_in_memory_index(p)) < 0)
+  if(!must_pin(pagetable))
   {
-      int memory_to_swap = swap_algo_page_index();
-      algo_file_swapout(memory_to_swap);
-      pages_memory_unused = memory_to_swap;
+    if((pa = walkaddr(pagetable, va)) == 0 && p != 0 && pagetable == p->pagetable &&
+       uvmlazy(pagetable, va, p->sz, 0) == 0)
+    {
+      pa = walkaddr(pagetable, va);
+    }
+    return pa;
   }
-  int index;
-  if ( (index = swapFile_page_virtualAddress(p, PGROUNDDOWN(virtual_addresss))) < 0 )
+  swap_lock(p);
+  while((pa = walkaddr(pagetable, va)) == 0)
   {
-    panic("page in swap file index fault");
+    if(uvmlazy(pagetable, va, p->sz, 1) == 0)
+    {
+      continue;
+    }
+    if(va >= MAXVA || (pte = walk(pagetable, va, 0)) == 0 ||
+       !(*pte & PTE_PG) || !(*pte & PTE_U))
+    {
+      swap_unlock(p);
+      return 0;
+    }
+    if((mem = ualloc()) == 0 || swapin(p, va, &pte, &mem, 1) < 0)
+    {
+      if(mem)
+      {
+        kfree(mem);
+      }
+      swap_unlock(p);
+      return 0;
+    }
   }
+  return pa;
+}
 
-  algo_file_swapin(index, pages_memory_unused);
-}
\ No newline at end of file
+void unpinpage(pagetable_t pagetable)
+{
+  if(must_pin(pagetable))
+  {
+    swap_unlock(myproc());
+  }
+}
+
+// Copy the paging counters of process pid, or of the whole
+// system if pid is 0, to the user address addr.
+int pgstat(int pid, uint64 addr)
+{
+  struct pgstat st;
+  struct proc *q;
+
+  if(pid == 0)
+  {
+    st = pgtotal;
+    st.wmark_low = KSWAPD_LOW;
+    st.wmark_high = KSWAPD_HIGH;
+    st.free_frames = headroom();
+    st.policy = ftab.policy;
+  }
+  else
+  {
+    memset(&st, 0, sizeof(st));
+    for(q = proc; q < &proc[NPROC]; q++)
+    {
+      acquire(&q->lock);
+      if(q->state != UNUSED && q->pid == pid)
+      {
+        st.minor = q->nminor;
+        st.major = q->nmajor;
+        st.swapins = q->nswapin;
+        st.swapouts = q->nswapout;
+        st.clean = q->nclean;
+        st.ra_pages = q->nra;
+        st.ra_hits = q->nrahit;
+        st.ra_misses = q->nramiss;
+        st.swap_rbytes = q->nrbytes;
+        st.swap_wbytes = q->nwbytes;
+        st.fault_ns = q->faultns;
+        st.policy = policy_of(q);
+        release(&q->lock);
+        break;
+      }
+      release(&q->lock);
+    }
+    if(q == &proc[NPROC])
+    {
+      return -1;
+    }
+  }
+  return copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st));
+}
@@ -18,9 +18,6 @@ struct context {
   uint64 s11;
 };
 
-#define MAX_PSYC_PAGES 16
-#define MAX_TOTAL_PAGES 32
-
 // Per-CPU state.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
@@ -85,16 +82,20 @@ struct trapframe {
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 
-struct pageInMemory{
-  int used_unused;
-  uint64 virtual_address;
-  uint age;
-};
-
-struct pageInSwapfile{
-  int used_unused;
-  uint64 virtual_address;
-  uint offset;
+// A physical page holding a user page of a process whose pages
+// can be swapped out. All of them are on one list, ftab in proc.c,
+// from which a victim is chosen across all processes.
+struct frame {
+  struct proc *owner;          // 0 if not tracked
+  uint64 va;                   // user virtual address in owner->pagetable
+  uint age;                    // for NFUA and LAPA
+  int pol;                     // replacement policy keeping it, PGP_*
+  int flags;                   // that policy's state of it, FR_*
+  int slot;                    // swap slot still holding a clean copy, or -1
+  int busy;                    // being swapped out, off the list
+  int ra;                      // read ahead, not seen used yet
+  struct frame *next;
+  struct frame *prev;
 };
 
 // Per-process state
@@ -122,9 +123,20 @@ struct proc {
   char name[16];               // Process name (debugging)
 
   struct file *swapFile;
-
-  struct pageInSwapfile pages_in_swapFile[MAX_PSYC_PAGES];
-  struct pageInMemory pages_in_memory[MAX_PSYC_PAGES];
-  int creation_order; // for scfifo swap algo
+  int swap_busy;                    // swap_lock() held, guarded by swapbusy_lock
+  uint64 nminor;                    // page faults fixed with no swap I/O
+  uint64 nmajor;                    // page faults that swapped a page in
+  uint64 nswapin;                   // pages read back from the swap area
+  uint64 nswapout;                  // pages swapped out
+  uint64 nclean;                    // of those, dropped clean with no write
+  uint64 nra;                       // pages read ahead of a fault
+  uint64 nrahit;                    // of those, used
+  uint64 nramiss;                   // and gone unused
+  uint64 nrbytes;                   // bytes read from swap
+  uint64 nwbytes;                   // bytes written to swap
+  uint64 faultns;                   // time spent in page faults
+  int ra_window;                    // pages to read ahead on the next fault
+  uint64 ra_next;                   // va a sequential fault comes at next
+  int pgpolicy;                     // replacement policy, or PGP_DEFAULT
   
 };
@@ -0,0 +1,354 @@
+// The swap area: pages of the disk past the end of the file system,
+// read and written straight through the virtio driver, with neither
+// the log nor the buffer cache in the way. A swapped out PTE holds the
+// page's slot, its index in the area. A slot is counted once for each
+// PTE or frame that holds it; fork shares slots rather than copying.
+//
+// In front of the disk is a pool of ZPOOL_PAGES pages of memory, in
+// which a page written to a slot is kept LZ-compressed if it fits in
+// ZMAX bytes (zswap). Only the pages that don't compress that well,
+// and the oldest ones in the pool when it fills, go to the disk; a
+// slot's page is in one place or the other. Every slot still has its
+// place on the disk, so the pool saves I/O, not swap space.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "defs.h"
+#include "fs.h"
+#include "pgstat.h"
+
+#define BPP (PGSIZE / BSIZE)   // blocks per page
+#define ZUNIT  64              // bytes of the pool handed out at a time
+#define ZMAX   (PGSIZE * 3/4)  // most compressed bytes worth keeping
+#define ZHEAD  NSWAPPAGE       // list sentinel in znext and zprev
+
+extern struct superblock sb;   // fs.c
+extern struct pgstat pgtotal;  // proc.c
+
+struct {
+  struct spinlock lock;
+  uint start;                  // first block of the area
+  int npage;                   // slots in the area
+  int nfree;
+  uint64 bitmap[NSWAPPAGE/64]; // used slots
+  uchar ref[NSWAPPAGE];        // holders of each used slot
+
+  // the pool: lock guards these too, but zio must be held to put
+  // pages in, take them out, or write them back, which keeps a
+  // page's units from being reused while they're read.
+  struct sleeplock zio;
+  char *zpage[ZPOOL_PAGES];
+  uint64 zused[ZPOOL_PAGES];   // used units of each page
+  int zloc[NSWAPPAGE];         // a slot's first unit in the pool, or -1
+  ushort zlen[NSWAPPAGE];      // and its compressed bytes
+  short znext[NSWAPPAGE+1];    // slots in the pool, oldest first, -1
+  short zprev[NSWAPPAGE+1];    // if not on the list
+  char zbuf[ZMAX];             // lz_compress() output
+  char *ztmp;                  // a page to write back from
+} swap;
+
+// index of the lowest set bit of x, which must not be 0.
+static int
+lowest_bit(uint64 x)
+{
+  int i = 0;
+
+  if((x & 0xFFFFFFFF) == 0){ x >>= 32; i += 32; }
+  if((x & 0xFFFF) == 0){ x >>= 16; i += 16; }
+  if((x & 0xFF) == 0){ x >>= 8; i += 8; }
+  if((x & 0xF) == 0){ x >>= 4; i += 4; }
+  if((x & 0x3) == 0){ x >>= 2; i += 2; }
+  if((x & 0x1) == 0)
+    i += 1;
+  return i;
+}
+
+// Find the swap area after the file system. Run after fsinit(),
+// which reads the superblock.
+void
+swapinit(void)
+{
+  uint64 blocks = virtio_disk_blocks();
+
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swap.zio, "zswap");
+  for(int i = 0; i < ZPOOL_PAGES; i++)
+    if((swap.zpage[i] = kalloc()) == 0)
+      panic("swapinit");
+  if((swap.ztmp = kalloc()) == 0)
+    panic("swapinit");
+  for(int i = 0; i < NSWAPPAGE; i++){
+    swap.zloc[i] = -1;
+    swap.znext[i] = swap.zprev[i] = -1;
+  }
+  swap.znext[ZHEAD] = swap.zprev[ZHEAD] = ZHEAD;
+  swap.start = sb.size;
+  swap.npage = blocks > sb.size ? (blocks - sb.size) / BPP : 0;
+  if(swap.npage > NSWAPPAGE)
+    swap.npage = NSWAPPAGE;
+  swap.nfree = swap.npage;
+  // slots past the end of the area are never free.
+  for(int i = swap.npage; i < NSWAPPAGE; i++)
+    swap.bitmap[i/64] |= 1L << (i%64);
+  printf("swap: %d pages at block %d, %d KB pool\n", swap.npage, swap.start,
+         ZPOOL_PAGES * PGSIZE / 1024);
+}
+
+// Take slot out of the pool. swap.lock must be held.
+static void
+zfree(int slot)
+{
+  int n = (swap.zlen[slot] + ZUNIT - 1) / ZUNIT;
+  int loc = swap.zloc[slot];
+
+  if(swap.znext[slot] >= 0){
+    swap.znext[swap.zprev[slot]] = swap.znext[slot];
+    swap.zprev[swap.znext[slot]] = swap.zprev[slot];
+    swap.znext[slot] = swap.zprev[slot] = -1;
+  }
+  swap.zused[loc / 64] &= ~(((1UL << n) - 1) << (loc % 64));
+  swap.zloc[slot] = -1;
+  pgtotal.zpages--;
+  pgtotal.zbytes -= swap.zlen[slot];
+}
+
+// Write the oldest page in the pool back to its place on the disk
+// and take it out. Returns -1 if the pool is empty. zio must be held.
+static int
+zwriteback(void)
+{
+  int slot, loc;
+
+  acquire(&swap.lock);
+  if((slot = swap.znext[ZHEAD]) == ZHEAD){
+    release(&swap.lock);
+    return -1;
+  }
+  // off the list, so that no other writeback takes it.
+  swap.znext[ZHEAD] = swap.znext[slot];
+  swap.zprev[swap.znext[slot]] = ZHEAD;
+  swap.znext[slot] = swap.zprev[slot] = -1;
+  loc = swap.zloc[slot];
+  release(&swap.lock);
+
+  // freed meanwhile, its units still hold it until zio is released.
+  if(lz_decompress(swap.zpage[loc / 64] + (loc % 64) * ZUNIT,
+                   swap.zlen[slot], swap.ztmp) < 0)
+    panic("zwriteback");
+  virtio_disk_rw_pages(swap.start + slot * BPP, &swap.ztmp, 1, 1);
+
+  acquire(&swap.lock);
+  if(swap.zloc[slot] == loc)
+    zfree(slot);
+  pgtotal.zwritebacks++;
+  release(&swap.lock);
+  return 0;
+}
+
+// Find n free units in one page of the pool. swap.lock must be held.
+static int
+zalloc(int n)
+{
+  uint64 mask = (1UL << n) - 1;
+
+  for(int i = 0; i < ZPOOL_PAGES; i++)
+    for(int u = 0; u + n <= 64; u++)
+      if((swap.zused[i] & (mask << u)) == 0){
+        swap.zused[i] |= mask << u;
+        return i * 64 + u;
+      }
+  return -1;
+}
+
+// Put page in the pool as slot's, writing back older pages to make
+// room if need be. Returns -1 if it doesn't compress well enough,
+// and must go to the disk. zio must be held.
+static int
+zstore(int slot, char *page)
+{
+  int len, loc;
+
+  // the slot's old copy is stale even if this one goes to the disk,
+  // where zload() must not find it first.
+  acquire(&swap.lock);
+  if(swap.zloc[slot] >= 0)
+    zfree(slot);
+  release(&swap.lock);
+
+  if((len = lz_compress(page, swap.zbuf, ZMAX)) < 0){
+    __sync_fetch_and_add(&pgtotal.zrejects, 1);
+    return -1;
+  }
+  acquire(&swap.lock);
+  while((loc = zalloc((len + ZUNIT - 1) / ZUNIT)) < 0){
+    release(&swap.lock);
+    if(zwriteback() < 0)
+      return -1;
+    acquire(&swap.lock);
+  }
+  memmove(swap.zpage[loc / 64] + (loc % 64) * ZUNIT, swap.zbuf, len);
+  swap.zloc[slot] = loc;
+  swap.zlen[slot] = len;
+  swap.znext[slot] = ZHEAD;
+  swap.zprev[slot] = swap.zprev[ZHEAD];
+  swap.znext[swap.zprev[ZHEAD]] = slot;
+  swap.zprev[ZHEAD] = slot;
+  pgtotal.zstores++;
+  pgtotal.zpages++;
+  pgtotal.zbytes += len;
+  release(&swap.lock);
+  return 0;
+}
+
+// Read slot's page from the pool into page. Returns -1 if it is on
+// the disk, where it stays. zio must be held.
+static int
+zload(int slot, char *page)
+{
+  int loc;
+
+  acquire(&swap.lock);
+  loc = swap.zloc[slot];
+  release(&swap.lock);
+  if(loc < 0)
+    return -1;
+  if(lz_decompress(swap.zpage[loc / 64] + (loc % 64) * ZUNIT,
+                   swap.zlen[slot], page) < 0)
+    panic("zload");
+  return 0;
+}
+
+// Allocate a free slot, -1 if the area is full.
+int
+swap_alloc(void)
+{
+  int slot = -1;
+
+  acquire(&swap.lock);
+  for(int w = 0; w < NSWAPPAGE/64; w++){
+    if(~swap.bitmap[w]){
+      int b = lowest_bit(~swap.bitmap[w]);
+      swap.bitmap[w] |= 1L << b;
+      swap.nfree--;
+      slot = w*64 + b;
+      swap.ref[slot] = 1;
+      break;
+    }
+  }
+  release(&swap.lock);
+  return slot;
+}
+
+// Allocate n adjacent free slots, or as many as the longest free
+// run has if none is that long. Returns the first and sets *got to
+// how many, or returns -1 if the area is full.
+int
+swap_alloc_run(int n, int *got)
+{
+  int best = -1, bestlen = 0, start = 0, len = 0;
+
+  acquire(&swap.lock);
+  for(int i = 0; i < swap.npage && bestlen < n; i++){
+    if(i % 64 == 0 && swap.bitmap[i/64] == ~0UL){
+      len = 0;
+      i += 63;
+      continue;
+    }
+    if(swap.bitmap[i/64] & (1L << (i%64))){
+      len = 0;
+      continue;
+    }
+    if(len++ == 0)
+      start = i;
+    if(len > bestlen){
+      best = start;
+      bestlen = len;
+    }
+  }
+  for(int i = best; i < best + bestlen; i++){
+    swap.bitmap[i/64] |= 1L << (i%64);
+    swap.ref[i] = 1;
+  }
+  swap.nfree -= bestlen;
+  release(&swap.lock);
+  *got = bestlen;
+  return best;
+}
+
+// Drop a hold on slot, which is free once none is left.
+void
+swap_free(int slot)
+{
+  acquire(&swap.lock);
+  if(slot < 0 || slot >= swap.npage || swap.ref[slot] == 0)
+    panic("swap_free");
+  if(--swap.ref[slot] == 0){
+    swap.bitmap[slot/64] &= ~(1L << (slot%64));
+    swap.nfree++;
+    if(swap.zloc[slot] >= 0)
+      zfree(slot);
+  }
+  release(&swap.lock);
+}
+
+// free slots; a hint, read without the lock.
+int
+swap_nfree(void)
+{
+  return swap.nfree;
+}
+
+// Read or write n pages from or to slots slot .. slot+n-1, at most
+// 64. Each goes to or comes from the pool if it can, and the rest
+// from or to the disk, a run of adjacent slots at a time.
+int
+swapio(int slot, char **pages, int n, int write)
+{
+  uint64 disk = 0;
+  int i, j;
+
+  if(slot < 0 || n < 1 || n > 64 || slot + n > swap.npage)
+    return -1;
+  acquiresleep(&swap.zio);
+  for(i = 0; i < n; i++)
+    if((write ? zstore(slot + i, pages[i]) : zload(slot + i, pages[i])) < 0)
+      disk |= 1UL << i;
+  releasesleep(&swap.zio);
+
+  // a slot on the disk stays there while it is read, and one being
+  // written isn't read.
+  for(i = 0; i < n; i = j){
+    for(j = i + 1; j < n && ((disk >> j) & 1) == ((disk >> i) & 1); j++)
+      ;
+    if(!write)
+      __sync_fetch_and_add((disk >> i) & 1 ? &pgtotal.zmisses : &pgtotal.zhits, j - i);
+    if((disk >> i) & 1)
+      virtio_disk_rw_pages(swap.start + (slot + i) * BPP, pages + i, j - i, write);
+  }
+  return 0;
+}
+
+// Share slot with a fork child, whose PTE holds it too. Whoever
+// swaps the page in gets a copy of its own, so the slot is never
+// written while shared.
+void
+swap_dup(int slot)
+{
+  acquire(&swap.lock);
+  if(slot < 0 || slot >= swap.npage || swap.ref[slot] == 0 || swap.ref[slot] == 255)
+    panic("swap_dup");
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// whether more than one PTE or frame holds slot, so that it must
+// not be written.
+int
+swap_shared(int slot)
+{
+  return swap.ref[slot] > 1;
+}
@@ -35,19 +35,34 @@ sys_wait(void)
   return wait(p);
 }
 
-uint64
-sys_sbrk(void)
+// sbrk() leaves the pages it adds for the first touch to map;
+// sbrkeager() maps them at once, for callers that would rather
+// not take the faults.
+static uint64
+dosbrk(int eager)
 {
   uint64 addr;
   int n;
 
   argint(0, &n);
   addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if(growproc(n, eager) < 0)
     return -1;
   return addr;
 }
 
+uint64
+sys_sbrk(void)
+{
+  return dosbrk(0);
+}
+
+uint64
+sys_sbrkeager(void)
+{
+  return dosbrk(1);
+}
+
 uint64
 sys_sleep(void)
 {
@@ -89,3 +104,27 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// paging counters of a process, or of the system if pid is 0.
+uint64
+sys_pgstat(void)
+{
+  int pid;
+  uint64 st;
+
+  argint(0, &pid);
+  argaddr(1, &st);
+  return pgstat(pid, st);
+}
+
+// page replacement policy of a process, or of the system if pid
+// is 0; see pgpolicy.h.
+uint64
+sys_pgpolicy(void)
+{
+  int pid, policy;
+
+  argint(0, &pid);
+  argint(1, &policy);
+  return pgpolicy(pid, policy);
+}
@@ -37,6 +37,7 @@ void
 usertrap(void)
 {
   int which_dev = 0;
+  uint64 t0 = r_time();
 
   if((r_sstatus() & SSTATUS_SPP) != 0)
     panic("usertrap: not from user mode");
@@ -65,14 +66,31 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 15 && uvmcow(p->pagetable, r_stval()) == 0){
+    // a store to a copy-on-write page, which is writable now.
+    pgfault_count(p, 0, t0);
+  } else if((r_scause() == 13 || r_scause() == 15) &&
+            uvmlazy(p->pagetable, r_stval(), p->sz, 1) == 0){
+    // the first touch of a page sbrk() left unmapped.
+    pgfault_count(p, 0, t0);
   } else if((which_dev = devintr()) != 0){
     // ok
     #ifndef NONE 
   }
-   else if (shouldIgnore(p) && ( r_scause() == 15 || r_scause() == 13  ) )
+   else if (shouldIgnore(p) && ( r_scause() == 15 || r_scause() == 13 || r_scause() == 12 ) )
    {
     uint64 virtual_addresss = r_stval();
-    dealWithPageFault(virtual_addresss);
+    int major;
+    if((major = dealWithPageFault(virtual_addresss)) < 0)
+    {
+      printf("usertrap(): bad page fault %p pid=%d\n", r_scause(), p->pid);
+      printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
+      setkilled(p);
+    }
+    else
+    {
+      pgfault_count(p, major, t0);
+    }
     #endif
    }
    else {
@@ -216,6 +234,7 @@ devintr()
     if(cpuid() == 0){
       clockintr();
     }
+    aging_tick();
     
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
@@ -169,8 +169,9 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
-// Optionally free the physical memory.
+// page-aligned. Pages sbrk() left unmapped are skipped.
+// Optionally free the physical memory, or the swap slot
+// of a page that is swapped out.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
@@ -181,16 +182,16 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0 && (*pte & PTE_PG) == 0)
-      panic("uvmunmap: not mapped");
+    if((pte = walk(pagetable, a, 0)) == 0 ||
+       ((*pte & PTE_V) == 0 && (*pte & PTE_PG) == 0))
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free && (*pte & PTE_PG) == 0){
       uint64 pa = PTE2PA(*pte);
       kfree((void*)pa);
-    }
+    } else if(do_free)
+      swapslot_free(PTE2SLOT(*pte));
     *pte = 0;
   }
 }
@@ -237,7 +238,7 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = ualloc();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
@@ -248,7 +249,7 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    addToMemory(a);
+    addToMemory(pagetable, a, (uint64)mem);
   }
   return newsz;
 }
@@ -265,11 +266,11 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
+    for(uint64 a = PGROUNDUP(newsz); a < PGROUNDUP(oldsz); a += PGSIZE)
+      removeMemoryPage(pagetable, a);
     uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
   }
 
-  removeMemoryPage(PGROUNDDOWN(oldsz));
-  
   return newsz;
 }
 
@@ -305,37 +306,60 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// With cow, the physical pages are shared:
+// writable ones become read-only copy-on-write
+// in both page tables, and the first store to
+// one copies it (uvmcow()). The caller must
+// flush the old page table's stale TLB entries.
+// Otherwise they are copied, since a page of a
+// process that swaps belongs to one page table.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
-uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+uvmcopy(pagetable_t old, pagetable_t new, uint64 sz, int cow)
 {
-  pte_t *pte;
+  pte_t *pte, *npte;
   uint64 pa, i;
   uint flags;
   char *mem;
 
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0 && (*pte & PTE_PG) == 0)
-      panic("uvmcopy: page not present");
+    if((pte = walk(old, i, 0)) == 0 ||
+       ((*pte & PTE_V) == 0 && (*pte & PTE_PG) == 0))
+      continue;  // not touched since sbrk()
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
 
-    if( (flags & PTE_PG) == 0)
+    if(cow && (flags & PTE_PG) == 0)
     {
-    if((mem = kalloc()) == 0)
+      if(*pte & PTE_W)
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+      if(mappages(new, i, PGSIZE, pa, PTE_FLAGS(*pte)) != 0)
+        goto err;
+      krefinc((void*)pa);
+    }
+    else if( (flags & PTE_PG) == 0)
+    {
+    if((mem = ualloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
-    
+    if(flags & PTE_COW)
+      flags = (flags & ~PTE_COW) | PTE_W;
+
     if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
       kfree(mem);
       goto err;
     }
     }
+    else
+    {
+      // swapped out: the child shares the slot, and each
+      // gets a copy of its own when it swaps the page in.
+      if((npte = walk(new, i, 1)) == 0)
+        goto err;
+      swap_dup(PTE2SLOT(*pte));
+      *npte = *pte;
+    }
   }
   return 0;
 
@@ -344,6 +368,72 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return -1;
 }
 
+// Give the copy-on-write page at va a copy of its own, or
+// take the page over if nothing else shares it any more,
+// and make it writable. Returns 0 if it is, -1 if va is
+// not a copy-on-write page or there's no memory for a copy.
+// The page is tracked from now on if the process swaps. It
+// may be copied under a spinlock (copyout()), so the copy
+// comes from kalloc(), and ualloc() makes room later.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(pagetable, va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_V | PTE_U | PTE_COW)) != (PTE_V | PTE_U | PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(krefcount((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, (char*)pa, PGSIZE);
+    *pte = PA2PTE(mem) | flags;
+    kfree((void*)pa);
+    pa = (uint64)mem;
+  }
+  sfence_vma();
+  addToMemory(pagetable, va, pa);
+  return 0;
+}
+
+// Map a zeroed page at va, which sbrk() left for the first touch
+// to map, and track it if the process swaps. Returns 0 if it did,
+// -1 if va is past sz, mapped or swapped out already, or there's no
+// memory. The page comes from ualloc() if it may swap pages out to
+// make room, else, under a spinlock, from kalloc().
+int
+uvmlazy(pagetable_t pagetable, uint64 va, uint64 sz, int canswap)
+{
+  pte_t *pte;
+  char *mem;
+
+  if(va >= sz)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(pagetable, va, 0)) != 0 && (*pte & (PTE_V | PTE_PG)))
+    return -1;
+  if((mem = canswap ? ualloc() : kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_R|PTE_W|PTE_U) != 0){
+    kfree(mem);
+    return -1;
+  }
+  addToMemory(pagetable, va, (uint64)mem);
+  return 0;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -364,16 +454,29 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = pinpage(pagetable, va0);
     if(pa0 == 0)
       return -1;
+    if((pte = walk(pagetable, va0, 0)) != 0 && (*pte & PTE_COW)){
+      if(uvmcow(pagetable, va0) < 0){
+        unpinpage(pagetable);
+        return -1;
+      }
+      pa0 = walkaddr(pagetable, va0);
+    }
+    // the write bypasses the MMU, so set A and D as it would, or a
+    // clean page that kept its swap slot is dropped with the data.
+    if((pte = walk(pagetable, va0, 0)) != 0)
+      __sync_fetch_and_or(pte, PTE_A | PTE_D);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
     memmove((void *)(pa0 + (dstva - va0)), src, n);
+    unpinpage(pagetable);
 
     len -= n;
     src += n;
@@ -392,13 +495,14 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = pinpage(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
     memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+    unpinpage(pagetable);
 
     len -= n;
     dst += n;
@@ -419,7 +523,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = pinpage(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -440,6 +544,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
       p++;
       dst++;
     }
+    unpinpage(pagetable);
 
     srcva = va0 + PGSIZE;
   }
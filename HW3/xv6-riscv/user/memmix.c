@@ -0,0 +1,129 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/pgstat.h"
+#include "kernel/pgpolicy.h"
+#include "user/user.h"
+
+// Processes with small hot sets run next to one that sweeps a large
+// array and one that only reads its array after filling it, together
+// needing more pages than the kernel keeps resident (NUSERFRAME).
+// Replacement is global, so the sweepers' pages should go rather
+// than the hot ones, and the reader's pages go clean, with no write.
+// The sweepers fault in order, so their pages should mostly come
+// back read ahead. Every process checks that its pages keep their
+// contents and prints its paging counters. The processes use the
+// given replacement policy, or the system's:
+//   memmix [rounds [scfifo|nfua|lapa|clockpro|arc]]
+
+#define PGSIZE        4096
+#define NS_PER_CYCLE  100   // qemu virt's time CSR runs at 10MHz
+#define NSMALL        4
+#define SMALLPAGES    12
+#define LARGEPAGES    80
+#define READPAGES     48
+
+int rounds = 10;
+char *names[] = PGP_NAMES;
+
+static inline uint64
+now(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+// write every page of an npages array passes times, checking what
+// the previous pass left there. A reader only writes the first time.
+void
+run(char *name, int npages, int passes, int reader)
+{
+  struct pgstat st;
+  uint64 *w, t0;
+  char *mem;
+
+  if((mem = sbrk(npages * PGSIZE)) == (char*)-1){
+    printf("memmix: sbrk failed\n");
+    exit(1);
+  }
+  t0 = now();
+  for(int r = 0; r < passes; r++){
+    for(int i = 0; i < npages; i++){
+      w = (uint64*)(mem + i * PGSIZE);
+      if(reader){
+        if(r > 0 && *w != i){
+          printf("memmix: %s lost page %d\n", name, i);
+          exit(1);
+        }
+        if(r == 0)
+          *w = i;
+        continue;
+      }
+      if(r > 0 && *w != (uint64)(r - 1) * npages + i){
+        printf("memmix: %s lost page %d\n", name, i);
+        exit(1);
+      }
+      *w = (uint64)r * npages + i;
+    }
+  }
+  t0 = now() - t0;
+  if(pgstat(getpid(), &st) < 0){
+    printf("memmix: pgstat failed\n");
+    exit(1);
+  }
+  printf("%s\t%d\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%l\n", name, npages,
+         st.minor, st.major, st.swapins, st.swapouts, st.clean, st.ra_pages,
+         st.ra_hits, st.ra_misses, t0 * NS_PER_CYCLE / 1000000);
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct pgstat st;
+  int pol;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(argc > 2){
+    for(pol = 0; pol < NPGPOLICY; pol++)
+      if(strcmp(argv[2], names[pol]) == 0)
+        break;
+    if(pol == NPGPOLICY || pgpolicy(getpid(), pol) < 0){
+      printf("memmix: no policy %s\n", argv[2]);
+      exit(1);
+    }
+  }
+  pgstat(getpid(), &st);
+
+  printf("# memmix rounds=%d policy=%s\n", rounds, names[st.policy]);
+  printf("proc\tpages\tminor\tmajor\tswapins\tswapouts\tclean\tra\tra_hits\tra_misses\tms\n");
+  for(int i = 0; i < NSMALL; i++)
+    if(fork() == 0)
+      run("small", SMALLPAGES, 8 * rounds, 0);
+  if(fork() == 0)
+    run("large", LARGEPAGES, rounds, 0);
+  if(fork() == 0)
+    run("reader", READPAGES, rounds, 1);
+  for(int i = 0; i < NSMALL + 2; i++){
+    wait(0);
+  }
+
+  if(pgstat(0, &st) < 0){
+    printf("memmix: pgstat failed\n");
+    exit(1);
+  }
+  printf("total\t-\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t-\n", st.minor, st.major,
+         st.swapins, st.swapouts, st.clean, st.ra_pages, st.ra_hits,
+         st.ra_misses);
+  printf("# kswapd wakeups=%l pages=%l direct=%l watermarks=%d/%d free=%d\n",
+         st.kswapd_wakeups, st.kswapd_pages, st.direct_pages,
+         st.wmark_low, st.wmark_high, st.free_frames);
+  // the compression ratio and the pool's hit rate, in thousandths.
+  printf("# zswap stores=%l rejects=%l writebacks=%l ratio=%l hits=%l/%l rate=%l\n",
+         st.zstores, st.zrejects, st.zwritebacks,
+         st.zbytes ? (uint64)st.zpages * PGSIZE * 1000 / st.zbytes : 0,
+         st.zhits, st.zhits + st.zmisses,
+         st.zhits + st.zmisses ? st.zhits * 1000 / (st.zhits + st.zmisses) : 0);
+  exit(0);
+}
@@ -0,0 +1,222 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/pgstat.h"
+#include "kernel/pgpolicy.h"
+#include "user/user.h"
+
+// Replacement policies against access patterns over more pages than
+// the kernel keeps resident (NUSERFRAME). Every pattern runs in a
+// fresh child under every policy, from the same seed, so all of them
+// see the same accesses. A run fills its pages, then makes naccess
+// accesses, writepct percent of them stores, checking what every
+// page holds. Prints one row per run, then the swap-ins of each
+// pattern under each policy:
+//   pattern  policy  minor  major  swapins  swapouts  swapio_kb  fault_us  ticks
+//   pagebench [pages [naccess [writepct [seed]]]]
+
+#define PGSIZE   4096
+#define STRIDE   8                           // stride pattern's step, in pages
+#define LOOP     (NUSERFRAME + NUSERFRAME/4) // loop pattern's pages, just over memory
+#define ZIPF_MAX (1 << 20)                   // weight of the most used page
+
+enum { SEQ, STRIDED, RANDOM, ZIPF, LOOPING, NPATTERN };
+char *patterns[NPATTERN] = { "seq", "stride", "random", "zipf", "loop" };
+char *policies[NPGPOLICY] = PGP_NAMES;
+
+int npages = 2 * NUSERFRAME;
+int naccess = 4000;
+int writepct = 30;
+uint64 seed = 1;
+
+struct result {
+  uint64 minor;
+  uint64 major;
+  uint64 swapins;
+  uint64 swapouts;
+  uint64 iobytes;
+  uint64 fault_ns;
+  int ticks;
+} res[NPATTERN][NPGPOLICY];
+
+uint64 rnd_state;
+
+// xorshift64.
+uint64
+rnd(void)
+{
+  rnd_state ^= rnd_state << 13;
+  rnd_state ^= rnd_state >> 7;
+  rnd_state ^= rnd_state << 17;
+  return rnd_state;
+}
+
+// cumulative weights of pages 0..npages-1, page i weighing
+// ZIPF_MAX / (i+1).
+uint64 *zipf_cum;
+
+void
+zipf_init(void)
+{
+  uint64 sum = 0;
+
+  if((zipf_cum = malloc(npages * sizeof(uint64))) == 0){
+    printf("pagebench: malloc failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < npages; i++){
+    sum += ZIPF_MAX / (i + 1);
+    zipf_cum[i] = sum;
+  }
+}
+
+int
+zipf(void)
+{
+  uint64 u = rnd() % zipf_cum[npages - 1];
+  int lo = 0, hi = npages - 1;
+
+  while(lo < hi){
+    int mid = (lo + hi) / 2;
+    if(zipf_cum[mid] > u)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+// the page of access k.
+int
+next_page(int pattern, int k)
+{
+  int per, loop;
+
+  switch(pattern){
+  case SEQ:
+    return k % npages;
+  case STRIDED:
+    // every STRIDE'th page, then the same from one page on.
+    per = (npages + STRIDE - 1) / STRIDE;
+    k %= per * STRIDE;
+    return ((k % per) * STRIDE + k / per) % npages;
+  case RANDOM:
+    return rnd() % npages;
+  case ZIPF:
+    return zipf();
+  default:
+    loop = npages < LOOP ? npages : LOOP;
+    return k % loop;
+  }
+}
+
+void
+run(int pattern, int policy, int fd)
+{
+  struct pgstat st0, st1;
+  struct result r;
+  uint64 *w;
+  char *mem;
+  int t0, page;
+
+  // the child starts out following the system's policy.
+  if(pgpolicy(getpid(), policy) < 0){
+    printf("pagebench: pgpolicy %s failed\n", policies[policy]);
+    exit(1);
+  }
+  if((mem = sbrk(npages * PGSIZE)) == (char*)-1){
+    printf("pagebench: sbrk failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < npages; i++)
+    *(uint64*)(mem + i * PGSIZE) = i;
+
+  rnd_state = seed;
+  if(pgstat(getpid(), &st0) < 0 || st0.policy != policy){
+    printf("pagebench: %s not in effect\n", policies[policy]);
+    exit(1);
+  }
+  t0 = uptime();
+  for(int k = 0; k < naccess; k++){
+    page = next_page(pattern, k);
+    w = (uint64*)(mem + page * PGSIZE);
+    if(*w != page){
+      printf("pagebench: %s lost page %d\n", patterns[pattern], page);
+      exit(1);
+    }
+    if(rnd() % 100 < writepct)
+      *w = page;
+  }
+  r.ticks = uptime() - t0;
+  pgstat(getpid(), &st1);
+
+  r.minor = st1.minor - st0.minor;
+  r.major = st1.major - st0.major;
+  r.swapins = st1.swapins - st0.swapins;
+  r.swapouts = st1.swapouts - st0.swapouts;
+  r.iobytes = st1.swap_rbytes - st0.swap_rbytes + st1.swap_wbytes - st0.swap_wbytes;
+  r.fault_ns = st1.fault_ns - st0.fault_ns;
+  write(fd, &r, sizeof(r));
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct result r;
+  int fds[2];
+
+  if(argc > 1)
+    npages = atoi(argv[1]);
+  if(argc > 2)
+    naccess = atoi(argv[2]);
+  if(argc > 3)
+    writepct = atoi(argv[3]);
+  if(argc > 4)
+    seed = atoi(argv[4]);
+  if(npages < 1 || naccess < 1 || seed == 0){
+    printf("usage: pagebench [pages [naccess [writepct [seed]]]]\n");
+    exit(1);
+  }
+  zipf_init();
+
+  printf("# pagebench pages=%d naccess=%d writepct=%d seed=%l frames=%d\n",
+         npages, naccess, writepct, seed, NUSERFRAME);
+  printf("pattern\tpolicy\tminor\tmajor\tswapins\tswapouts\tswapio_kb\tfault_us\tticks\n");
+  for(int pat = 0; pat < NPATTERN; pat++){
+    for(int pol = 0; pol < NPGPOLICY; pol++){
+      if(pipe(fds) < 0){
+        printf("pagebench: pipe failed\n");
+        exit(1);
+      }
+      if(fork() == 0){
+        close(fds[0]);
+        run(pat, pol, fds[1]);
+      }
+      close(fds[1]);
+      if(read(fds[0], &r, sizeof(r)) != sizeof(r)){
+        printf("pagebench: %s under %s failed\n", patterns[pat], policies[pol]);
+        exit(1);
+      }
+      close(fds[0]);
+      wait(0);
+      res[pat][pol] = r;
+      printf("%s\t%s\t%l\t%l\t%l\t%l\t%l\t%l\t%d\n", patterns[pat], policies[pol],
+             r.minor, r.major, r.swapins, r.swapouts, r.iobytes / 1024,
+             r.fault_ns / 1000, r.ticks);
+    }
+  }
+
+  printf("# swapins\n");
+  printf("pattern");
+  for(int pol = 0; pol < NPGPOLICY; pol++)
+    printf("\t%s", policies[pol]);
+  printf("\n");
+  for(int pat = 0; pat < NPATTERN; pat++){
+    printf("%s", patterns[pat]);
+    for(int pol = 0; pol < NPGPOLICY; pol++)
+      printf("\t%l", res[pat][pol].swapins);
+    printf("\n");
+  }
+  exit(0);
+}
@@ -0,0 +1,46 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/pgpolicy.h"
+#include "user/user.h"
+
+// Show or set the page replacement policy of the system, or of one
+// process; "default" makes a process follow the system's again:
+//   pgpolicy [scfifo|nfua|lapa|clockpro|arc|default [pid]]
+
+char *names[] = PGP_NAMES;
+
+int
+main(int argc, char **argv)
+{
+  int pid = 0, pol = PGP_GET, old;
+
+  if(argc > 3){
+    fprintf(2, "usage: pgpolicy [policy [pid]]\n");
+    exit(1);
+  }
+  if(argc > 1){
+    if(strcmp(argv[1], "default") == 0)
+      pol = PGP_DEFAULT;
+    else {
+      for(pol = 0; pol < NPGPOLICY; pol++)
+        if(strcmp(argv[1], names[pol]) == 0)
+          break;
+      if(pol == NPGPOLICY){
+        fprintf(2, "pgpolicy: no policy %s\n", argv[1]);
+        exit(1);
+      }
+    }
+  }
+  if(argc > 2)
+    pid = atoi(argv[2]);
+  if((old = pgpolicy(pid, pol)) < 0){
+    fprintf(2, "pgpolicy: failed\n");
+    exit(1);
+  }
+  if(pol != PGP_GET)
+    printf("%s -> %s\n", old == PGP_DEFAULT ? "default" : names[old],
+           pol == PGP_DEFAULT ? "default" : names[pol]);
+  else
+    printf("%s\n", old == PGP_DEFAULT ? "default" : names[old]);
+  exit(0);
+}
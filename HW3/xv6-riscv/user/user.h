@@ -1,4 +1,5 @@
 struct stat;
+struct pgstat;
 
 // system calls
 int fork(void);
@@ -20,8 +21,11 @@ int chdir(const char*);
 int dup(int);
 int getpid(void);
 char* sbrk(int);
+char* sbrkeager(int);
 int sleep(int);
 int uptime(void);
+int pgstat(int, struct pgstat*);
+int pgpolicy(int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
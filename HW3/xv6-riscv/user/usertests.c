@@ -2554,6 +2554,60 @@ sbrk8000(char *s)
   *(top-1) = *(top-1) + 1;
 }
 
+// regression test. read() fills a user page through the kernel's
+// mapping, which used to leave the page's dirty bit clear, so a page
+// swapped back in, filled by read(), then swapped out again was
+// dropped as clean, and came back without what read() put there.
+void
+swapread(char *s)
+{
+  enum { N = 2*NUSERFRAME };
+  char buf[512];
+  volatile char *a;
+  int fds[2];
+
+  a = sbrk(N*PGSIZE);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  // more pages than stay resident, so the first ones go out.
+  for(int i = 0; i < N; i++)
+    a[i*PGSIZE] = 1;
+
+  // bring page 0 back in, clean, and read() into it.
+  if(a[0] != 1){
+    printf("%s: lost page 0\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  write(fds[1], buf, sizeof(buf));
+  if(read(fds[0], (char*)a + 64, sizeof(buf)) != sizeof(buf)){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  // push page 0 out again, reading the others only.
+  for(int r = 0; r < 4; r++)
+    for(int i = 1; i < N; i++)
+      if(a[i*PGSIZE] != 1){
+        printf("%s: lost page %d\n", s, i);
+        exit(1);
+      }
+
+  if(memcmp((char*)a + 64, buf, sizeof(buf)) != 0){
+    printf("%s: page 0 lost what read() put there\n", s);
+    exit(1);
+  }
+}
+
 
 
 // regression test. test whether exec() leaks memory if one of the
@@ -2634,6 +2688,7 @@ struct test {
   {sbrkbugs, "sbrkbugs" },
   {sbrklast, "sbrklast"},
   {sbrk8000, "sbrk8000"},
+  {swapread, "swapread"},
   {badarg, "badarg" },
 
   { 0, 0},
@@ -23,10 +23,20 @@ struct {
   struct run *freelist;
 } kmem;
 
+// References to each page kalloc() handed out. A page
+// shared copy-on-write after fork() has more than one.
+struct {
+  struct spinlock lock;
+  int count[(PHYSTOP - KERNBASE) / PGSIZE];
+} kref;
+
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  initlock(&kref.lock, "kref");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,14 +45,17 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kref.count[PA2REF(p)] = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by pa, and free it if that was the last one. pa
+// normally should have been returned by a call to
+// kalloc().  (The exception is when initializing the
+// allocator; see kinit above.)
 void
 kfree(void *pa)
 {
@@ -51,6 +64,15 @@ kfree(void *pa)
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  acquire(&kref.lock);
+  if(kref.count[PA2REF(pa)] < 1)
+    panic("kfree: ref");
+  if(--kref.count[PA2REF(pa)] > 0){
+    release(&kref.lock);
+    return;
+  }
+  release(&kref.lock);
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
@@ -76,7 +98,27 @@ kalloc(void)
     kmem.freelist = r->next;
   release(&kmem.lock);
 
-  if(r)
+  if(r){
     memset((char*)r, 5, PGSIZE); // fill with junk
+    kref.count[PA2REF(r)] = 1;
+  }
   return (void*)r;
+}
+
+// Add a reference to the page at pa, from kalloc().
+void
+krefinc(void *pa)
+{
+  acquire(&kref.lock);
+  if(kref.count[PA2REF(pa)] < 1)
+    panic("krefinc");
+  kref.count[PA2REF(pa)]++;
+  release(&kref.lock);
+}
+
+// the number of references to the page at pa.
+int
+krefcount(void *pa)
+{
+  return kref.count[PA2REF(pa)];
 }
\ No newline at end of file
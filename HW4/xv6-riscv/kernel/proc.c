@@ -254,17 +254,22 @@ userinit(void)
   release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
+// Grow or shrink user memory by n bytes. New pages are
+// mapped by their first touch (uvmlazy()), unless eager.
 // Return 0 on success, -1 on failure.
 int
-growproc(int n)
+growproc(int n, int eager)
 {
   uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    if(sz + n > TRAPFRAME)
+      return -1;
+    if(!eager)
+      sz += n;
+    else if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
       return -1;
     }
   } else if(n < 0){
@@ -294,6 +299,8 @@ fork(void)
     release(&np->lock);
     return -1;
   }
+  // the parent's writable pages are copy-on-write now.
+  sfence_vma();
   np->sz = p->sz;
 
   // copy saved user registers.
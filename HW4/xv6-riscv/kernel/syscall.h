@@ -20,4 +20,5 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
-#define SYS_seek  22
\ No newline at end of file
+#define SYS_seek  22
+#define SYS_sbrkeager  23
\ No newline at end of file
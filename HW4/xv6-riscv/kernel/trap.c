@@ -65,6 +65,11 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 15 && uvmcow(p->pagetable, r_stval()) == 0){
+    // a store to a copy-on-write page, which is writable now.
+  } else if((r_scause() == 13 || r_scause() == 15) &&
+            uvmlazy(p->pagetable, r_stval(), p->sz) == 0){
+    // the first touch of a page sbrk() left unmapped.
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
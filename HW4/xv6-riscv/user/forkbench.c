@@ -0,0 +1,126 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+// Cost of fork() against the size of the parent's heap. Copy-on-write
+// fork maps the parent's pages instead of copying them, so a child that
+// exits at once should cost about the same whatever the heap, while one
+// that stores to every page pays for the copies as it goes. Then counts
+// how many children, each blocked in read(), fit next to the largest
+// heap at once. Prints one tab-separated row per result:
+//   bench  pages  value  unit
+//   forkbench [maxpages]
+//
+// The same file is in every tree but HW1's, whose exit() and wait()
+// take its extra argument. A tree that swaps (NUSERFRAME) gets a
+// smaller default heap.
+
+#define PGSIZE        4096
+#define NS_PER_CYCLE  100   // qemu virt's time CSR runs at 10MHz
+#define ROUNDS        10
+#define MAXKIDS       32
+
+#ifdef NUSERFRAME
+int maxpages = NSWAPPAGE / 4;   // parent and child swap, within NSWAPPAGE
+#else
+int maxpages = 1024;
+#endif
+char *heap;
+int npages;
+
+static inline uint64
+now(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+void
+report(char *bench, int pages, uint64 value, char *unit)
+{
+  printf("%s\t%d\t%l\t%s\n", bench, pages, value, unit);
+}
+
+// grow the heap to n pages, each stored to so that it is resident.
+void
+grow(int n)
+{
+  if(sbrk((n - npages) * PGSIZE) == (char*)-1){
+    printf("forkbench: sbrk failed\n");
+    exit(1);
+  }
+  for(; npages < n; npages++)
+    heap[npages * PGSIZE] = npages;
+}
+
+// us per fork() of a child that stores to touch pages of the heap,
+// then exits, and the parent's wait() for it.
+uint64
+bench_fork(int touch)
+{
+  uint64 t0 = now();
+  int pid;
+
+  for(int r = 0; r < ROUNDS; r++){
+    if((pid = fork()) < 0){
+      printf("forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      for(int i = 0; i < touch; i++)
+        heap[i * PGSIZE]++;
+      exit(0);
+    }
+    wait(0);
+  }
+  return (now() - t0) * NS_PER_CYCLE / 1000 / ROUNDS;
+}
+
+// children that fork() until it fails or MAXKIDS, each blocked in a
+// read() of a pipe until the parent closes it.
+int
+bench_blocked(void)
+{
+  int fds[2], n;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("forkbench: pipe failed\n");
+    exit(1);
+  }
+  for(n = 0; n < MAXKIDS; n++){
+    int pid = fork();
+    if(pid < 0)
+      break;
+    if(pid == 0){
+      close(fds[1]);
+      read(fds[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for(int i = 0; i < n; i++)
+    wait(0);
+  return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1)
+    maxpages = atoi(argv[1]);
+  heap = sbrk(0);
+
+  printf("# forkbench maxpages=%d rounds=%d\n", maxpages, ROUNDS);
+  printf("bench\tpages\tvalue\tunit\n");
+  for(int n = 64; n <= maxpages; n *= 2){
+    grow(n);
+    report("fork_exit", n, bench_fork(0), "us");
+    report("fork_touch_exit", n, bench_fork(n), "us");
+  }
+  report("fork_blocked", npages, bench_blocked(), "procs");
+  exit(0);
+}
@@ -36,4 +36,5 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
-entry("seek");
\ No newline at end of file
+entry("seek");
+entry("sbrkeager");
\ No newline at end of file